@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+
+// Sample rate and block size pairs to pick from while running
+//
+// Smaller blocks get the notes out sooner but the callback overhead is
+// paid more often. The filter shaper aliases at 48kHz, so the 48kHz
+// profiles run the filter at 2x (Synth::SetFilterOversampling), -80dB
+// instead of -69dB in ./build/bench oversampling, 96kHz at 1x is -88dB.
+// FieldWrap::SetAudioProfile switches, see Swarm.cpp for what has to be
+// set up again after
+
+enum AudioProfile {
+  AUDIO_LOW_LATENCY = 0, // 48kHz, 4 samples, filter at 2x
+  AUDIO_BALANCED,        // 48kHz, 32 samples, filter at 2x
+  AUDIO_HIFI,            // 96kHz, 16 samples, what it always ran at
+  AUDIO_NUM_PROFILES,
+};
+
+struct AudioProfileConfig {
+  const char *name; // short enough for the display
+  float sampleRate;
+  size_t blockSize;
+  int filterOversampling; // for Synth::SetFilterOversampling
+};
+
+inline const AudioProfileConfig &GetAudioProfileConfig(int profile) {
+  static const AudioProfileConfig configs[AUDIO_NUM_PROFILES] = {
+      {"48k/4", 48000.0f, 4, 2},
+      {"48k/32", 48000.0f, 32, 2},
+      {"96k/16", 96000.0f, 16, 1},
+  };
+  return configs[profile];
+}
+
+/**
+ * Time from a note arriving to it being heard: one block waiting so the
+ * MIDI keeps its offset in the block (see Synth::QueueEvent) and one block
+ * in the output buffer
+ *
+ * @param blockPeriod Time per block, measured or blockSize / sampleRate,
+ * the latency comes out in the same unit
+ */
+inline float GetAudioLatency(float blockPeriod) { return 2.0f * blockPeriod; }
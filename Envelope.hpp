@@ -1,5 +1,48 @@
 #pragma once
 
+#include "FastMath.hpp"
+#include <cmath>
+#include <cstddef>
+
+// samples between the values worked out in CONTROL_RATE, the default
+#define ENVELOPE_CONTROL_INTERVAL 16
+// a stage shorter than this many intervals runs every sample instead
+#define ENVELOPE_MIN_INTERVALS 4
+
+// x^curve for x from 0 to 1, read with linear interpolation
+// the only pow calls are in Set
+class CurveTable {
+public:
+  // 1 (linear) to 4
+  void Set(float curve) {
+    curve_ = (curve < 1.0f) ? 1.0f : (curve > 4.0f ? 4.0f : curve);
+    // the ends are exact, the attack only ends when it reaches 1
+    table_[0] = 0.0f;
+    for (int i = 1; i < size_; i++) {
+      table_[i] = FastPow<FAST_HIGH>(float(i) / size_, curve_);
+    }
+    table_[size_] = 1.0f;
+    // guard point so the interpolation at 1.0 stays in the table
+    table_[size_ + 1] = 1.0f;
+  }
+
+  float GetCurve() const { return curve_; }
+
+  // x is clamped to 0 to 1
+  float Lookup(float x) const {
+    x = (x < 0.0f) ? 0.0f : (x > 1.0f ? 1.0f : x);
+    float f = x * size_;
+    int i = static_cast<int>(f);
+    float t = f - i;
+    return table_[i] + t * (table_[i + 1] - table_[i]);
+  }
+
+private:
+  static constexpr int size_ = 256;
+  float curve_;
+  float table_[size_ + 2];
+};
+
 class Envelope {
 public:
   Envelope() {}
@@ -7,82 +50,118 @@ public:
 
   enum Stage { OFF = 0, ATTACK, DECAY };
 
+  // How ProcessBlock works the envelope out
+  enum RateMode {
+    AUDIO_RATE = 0, // every sample
+    CONTROL_RATE,   // every interval samples, a straight line in between
+  };
+
   void Init(float sr) {
     sr_ = sr;
-    stageTime_ = 0.0f;
+    pos_ = 0.0f;
     stageTimeInc_ = 1.0f / sr_; // samples in one second
     stage_ = OFF;
     attack_ = 0.1f;    // seconds
     addAttack_ = 0.0f; // seconds
     decay_ = 1.0f;     // seconds
     addDecay_ = 0.0f;  // seconds
-    curve_ = 2.0f;
     scale_ = 1.0f;
     out_ = 0.0f;
+    jumped_ = false;
+    SetRateMode(AUDIO_RATE);
+    calcRates();
+    SetCurve(2.0f);
+  }
+
+  // interval is in samples, only used by CONTROL_RATE
+  void SetRateMode(RateMode mode, size_t interval = ENVELOPE_CONTROL_INTERVAL) {
+    rateMode_ = mode;
+    interval_ = interval < 1 ? 1 : interval;
+    invInterval_ = 1.0f / interval_;
+    maxControlRate_ = 1.0f / (interval_ * ENVELOPE_MIN_INTERVALS);
+  }
+  RateMode GetRateMode() { return rateMode_; }
+  size_t GetRateInterval() { return interval_; }
+
+  // 0.001sec to 5sec
+  static float ClampTime(float t) {
+    return (t < 0.001f) ? 0.001f : (t > 5.0f ? 5.0f : t);
+  }
+  // 0 to 1
+  static float ClampScale(float s) {
+    return (s < 0.0f) ? 0.0f : (s > 1.0f ? 1.0f : s);
   }
 
-  // 0.001sec to 10sec
   void SetAttack(float attack) {
-    attack_ = (attack < 0.001f) ? 0.001f : (attack > 5.0f ? 5.0f : attack);
+    attack_ = ClampTime(attack);
+    calcRates();
   }
 
   void AddAttack(float addAttack) {
     addAttack_ =
         (addAttack < 0.0f) ? 0.0f : (addAttack > 5.0f ? 5.0f : addAttack);
+    calcRates();
   }
 
   void SetDecay(float decay) {
-    decay_ = (decay < 0.001f) ? 0.001f : (decay > 5.0f ? 5.0f : decay);
+    decay_ = ClampTime(decay);
+    calcRates();
   }
 
   void AddDecay(float addDecay) {
     addDecay_ = (addDecay < 0.0f) ? 0.0f : (addDecay > 5.0f ? 5.0f : addDecay);
+    calcRates();
   }
 
   void SetScale(float scale) {
-    scale_ = (scale < 0.0f) ? 0.0f : (scale > 1.0f ? 1.0f : scale);
+    scale_ = ClampScale(scale);
   }
 
+  // Makes the envelope's own curve table, slow
   void SetCurve(float curve) {
-    curve_ = (curve < 1.0f) ? 1.0f : (curve > 4.0f ? 4.0f : curve);
+    ownCurve_.Set(curve);
+    curve_ = &ownCurve_;
   }
 
+  // Use a table made somewhere else (eg shared between voices), it has to
+  // stay around while the envelope uses it
+  void SetCurveTable(const CurveTable *table) { curve_ = table; }
+
   void Trigger() {
     if (out_ == 0.0f) {
-      stageTime_ = 0.0f;
+      pos_ = 0.0f;
     } else {
       // retriggers, to avoid click
       // TODO make this an option, filter should not retrigger
-      stageTime_ = out_ * (attack_ + addAttack_);
+      pos_ = out_;
     }
     stage_ = ATTACK;
+    jumped_ = true;
   }
 
   void Release() {
     if (stage_ != OFF && stage_ != DECAY) {
-      stageTime_ = 0.0f;
+      pos_ = 0.0f;
       stage_ = DECAY;
+      jumped_ = true;
     }
   }
 
   float Process() {
     // attack
     if (stage_ == ATTACK) {
-      stageTime_ += stageTimeInc_;
-      out_ = stageTime_ / (attack_ + addAttack_);
-      out_ = powf(out_, curve_);
+      pos_ += attackRate_;
+      out_ = curve(pos_);
       // end of attack, go to decay
       if (out_ >= 1.0f) {
-        stageTime_ = 0.0f;
+        pos_ = 0.0f;
         stage_ = DECAY;
       }
     }
 
     if (stage_ == DECAY) {
-      stageTime_ += stageTimeInc_;
-      out_ = stageTime_ / (decay_ + addDecay_);
-      out_ = 1.0f - out_;
-      out_ = powf(out_, curve_);
+      pos_ += decayRate_;
+      out_ = curve(1.0f - pos_);
       // end of decay, stop
       if (out_ <= 0.0001f) {
         out_ = 0.0f;
@@ -92,14 +171,123 @@ public:
     return out_ * scale_;
   }
 
+  // Fill a buffer with the next size samples
+  void ProcessBlock(float *out, size_t size) {
+    if (rateMode_ == CONTROL_RATE) {
+      processControlRate(out, size);
+    } else {
+      processAudioRate(out, size);
+    }
+  }
+
+  // false once the decay has finished
+  bool IsActive() { return stage_ != OFF; }
+  // last output, scaled
+  float GetOutput() { return out_ * scale_; }
+
   float GetAttack() { return attack_; }
   float GetDecay() { return decay_; }
   float GetScale() { return scale_; }
-  float GetCurve() { return curve_; }
+  float GetCurve() { return curve_->GetCurve(); }
 
 private:
   // Stage: OFF 0, ATTACK 1, DECAY 2
   Stage stage_;
-  float sr_, stageTime_, stageTimeInc_, attack_, addAttack_, decay_, addDecay_,
-      curve_, scale_, out_;
-};
\ No newline at end of file
+  float sr_, stageTimeInc_, attack_, addAttack_, decay_, addDecay_, scale_,
+      out_;
+  // position in the current stage, 0 to 1
+  float pos_;
+  // position increment per sample, only changes with attack and decay
+  float attackRate_, decayRate_;
+  RateMode rateMode_;
+  size_t interval_; // samples, for CONTROL_RATE
+  float invInterval_;
+  // faster than this runs every sample, stages under ENVELOPE_MIN_INTERVALS
+  float maxControlRate_;
+  // Trigger or Release moved the position since the last value
+  bool jumped_;
+
+  // the table in use, ownCurve_ unless SetCurveTable was called
+  const CurveTable *curve_;
+  CurveTable ownCurve_;
+
+  // ProcessBlock in CONTROL_RATE
+  void processControlRate(float *out, size_t size) {
+    // the value at the end of every interval and a straight line to it from
+    // the last one. An interval where the stage ends, or a stage too short
+    // for a few intervals, runs every sample so the corners stay sharp
+    while (size > 0) {
+      size_t n = size < interval_ ? size : interval_;
+      float from = out_;
+      float to = out_;
+      if (stage_ != OFF) {
+        float rate = stage_ == ATTACK ? attackRate_ : decayRate_;
+        float pos = pos_ + rate * n;
+        to = stage_ == ATTACK ? curve(pos) : curve(1.0f - pos);
+        bool ends = stage_ == ATTACK ? to >= 1.0f : to <= 0.0001f;
+        if (ends || rate > maxControlRate_) {
+          processAudioRate(out, n);
+          out += n;
+          size -= n;
+          continue;
+        }
+        if (jumped_) {
+          // a trigger moved the position, the curve jumps like it does
+          // every sample instead of sliding from out_
+          from = stage_ == ATTACK ? curve(pos_) : curve(1.0f - pos_);
+          jumped_ = false;
+        }
+        pos_ = pos;
+        out_ = to;
+      }
+      float start = from * scale_;
+      float invN = n == interval_ ? invInterval_ : 1.0f / n;
+      float inc = (to - from) * scale_ * invN;
+      // an int counter, size_t to float doesn't vectorize
+      for (int i = 0; i < static_cast<int>(n); i++) {
+        out[i] = start + inc * (i + 1);
+      }
+      out += n;
+      size -= n;
+    }
+  }
+
+  // ProcessBlock in AUDIO_RATE
+  void processAudioRate(float *out, size_t size) {
+    // work on locals so they stay in registers for the whole block
+    Stage stage = stage_;
+    float pos = pos_;
+    float env = out_;
+
+    for (size_t i = 0; i < size; i++) {
+      if (stage == ATTACK) {
+        pos += attackRate_;
+        env = curve(pos);
+        if (env >= 1.0f) {
+          pos = 0.0f;
+          stage = DECAY;
+        }
+      }
+      if (stage == DECAY) {
+        pos += decayRate_;
+        env = curve(1.0f - pos);
+        if (env <= 0.0001f) {
+          env = 0.0f;
+          stage = OFF;
+        }
+      }
+      out[i] = env * scale_;
+    }
+
+    stage_ = stage;
+    pos_ = pos;
+    out_ = env;
+  }
+
+  void calcRates() {
+    attackRate_ = stageTimeInc_ / (attack_ + addAttack_);
+    decayRate_ = stageTimeInc_ / (decay_ + addDecay_);
+  }
+
+  float curve(float x) { return curve_->Lookup(x); }
+};
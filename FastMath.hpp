@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Cheap stand-ins for the libm functions, for code that runs every block
+// or every sample
+//
+// Every function comes in three precision tiers, picked with the template
+// argument, eg FastExp2<FAST_LOW>(x). The tiers are polynomials of
+// different degrees, so the cost is fixed and there are no branches or
+// table reads, a loop over them vectorizes at -O3.
+//
+// The error bounds below are worked out rather than measured: the largest
+// error of the polynomial over its range in exact arithmetic (with the
+// coefficients as floats), plus the float rounding, one u = 2^-24 for each
+// degree of the polynomial and what the function adds around it, all times 2
+// for margin. ./build/bench fastmath checks them against libm, along with
+// the speed
+
+enum FastPrecision {
+  FAST_LOW = 0, // eg modulation and display
+  FAST_MEDIUM,  // pitch, within 0.01 cents
+  FAST_HIGH,    // close to float precision
+};
+
+// the polynomials for each tier
+template <int P> struct FastPoly;
+
+template <> struct FastPoly<FAST_LOW> {
+  // 2^f for f in [0, 1)
+  static float Exp2(float f) {
+    return 0.9999252f + f * (0.6958335f + f * (0.22606719f + f * 0.0780245f));
+  }
+  // log2(1 + t) for t in [0, 1)
+  static float Log2(float t) {
+    return t * (1.4245938f + t * (-0.58920646f + t * 0.1653836f));
+  }
+  // sin(2 pi r) for r in [-0.25, 0.25]
+  static float Sin(float r) {
+    float s = r * r;
+    return r * (6.192265f + s * -35.36371f);
+  }
+};
+
+template <> struct FastPoly<FAST_MEDIUM> {
+  static float Exp2(float f) {
+    return 1.0000026f +
+           f * (0.69300383f +
+                f * (0.24144275f + f * (0.052011468f + f * 0.013534165f)));
+  }
+  static float Log2(float t) {
+    return t *
+           (1.4419656f +
+            t * (-0.7096628f +
+                 t * (0.41759568f + t * (-0.19626951f + t * 0.046385307f))));
+  }
+  static float Sin(float r) {
+    float s = r * r;
+    return r * (6.28128f + s * (-41.095242f + s * 73.58552f));
+  }
+};
+
+template <> struct FastPoly<FAST_HIGH> {
+  static float Exp2(float f) {
+    return 0.99999994f +
+           f * (0.6931531f +
+                f * (0.24015361f +
+                     f * (0.055826318f +
+                          f * (0.0089893425f + f * 0.0018775759f))));
+  }
+  static float Log2(float t) {
+    return t *
+           (1.4426678f +
+            t * (-0.72058547f +
+                 t * (0.47355345f +
+                      t * (-0.32590207f +
+                           t * (0.19429445f +
+                                t * (-0.07955783f + t * 0.015529945f))))));
+  }
+  static float Sin(float r) {
+    float s = r * r;
+    return r * (6.283164f +
+                s * (-41.337143f + s * (81.34077f + s * -70.99344f)));
+  }
+};
+
+// floor for values an int can hold, the cast rounds towards 0
+inline int fastFloor(float x) {
+  int whole = static_cast<int>(x);
+  return whole - (x < whole ? 1 : 0);
+}
+
+// x limited to lo to hi for finite x. Done with arithmetic on the compares,
+// a ternary on floats is a branch to GCC unless -fno-trapping-math, and
+// that stops a loop around it vectorizing
+inline float fastClamp(float x, float lo, float hi) {
+  float below = x < lo;
+  float above = x > hi;
+  return x * (1.0f - below - above) + lo * below + hi * above;
+}
+
+/**
+ * 2^x, relative error under 1.5e-4 (FAST_LOW), 5.8e-6 (FAST_MEDIUM) or
+ * 7.8e-7 (FAST_HIGH). The polynomials are off by 7.48e-5, 2.62e-6 and
+ * 9.0e-8, the whole part is exact
+ *
+ * @param x Clamped to -126 to 126
+ */
+template <int P = FAST_MEDIUM> inline float FastExp2(float x) {
+  x = fastClamp(x, -126.0f, 126.0f);
+  // the whole part goes straight into the exponent bits
+  int whole = fastFloor(x);
+  uint32_t bits = static_cast<uint32_t>(whole + 127) << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return FastPoly<P>::Exp2(x - whole) * scale;
+}
+
+/**
+ * log2(x), absolute error under 1.6e-3 (FAST_LOW), 3.2e-5 (FAST_MEDIUM) or
+ * 3.4e-6 (FAST_HIGH) for x from 1e-6 to 1000. The polynomials are off by
+ * 7.71e-4, 1.43e-5 and 3.2e-7, adding the exponent rounds to 2^-20 with the
+ * result up to 20, that's most of the FAST_HIGH bound
+ *
+ * @param x Above 0, denormals and 0 come out as -127
+ */
+template <int P = FAST_MEDIUM> inline float FastLog2(float x) {
+  // exponent bits for the whole part, the mantissa is 1 to 2
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  int exponent = static_cast<int>((bits >> 23) & 0xff) - 127;
+  bits = (bits & 0x007fffff) | 0x3f800000;
+  float mantissa;
+  memcpy(&mantissa, &bits, sizeof(mantissa));
+  return exponent + FastPoly<P>::Log2(mantissa - 1.0f);
+}
+
+/**
+ * x^y as 2^(y log2(x)), the error grows with |y log2(x)|. For x from 0 to 1
+ * and y from 1 to 4 (the envelope curves) the absolute error is under
+ * 4.5e-3 (FAST_LOW), 8.7e-5 (FAST_MEDIUM) or 4.9e-6 (FAST_HIGH): the
+ * FastLog2 polynomial error times y ln(2), without the exponent rounding as
+ * x^y is small when log2(x) is big, plus the FastExp2 error
+ *
+ * @param x Above 0, 0 gives (close to) 0 for positive y
+ */
+template <int P = FAST_MEDIUM> inline float FastPow(float x, float y) {
+  return FastExp2<P>(y * FastLog2<P>(x));
+}
+
+/**
+ * tanh(x) from 2^(2x log2(e)), absolute error under 7.6e-5 (FAST_LOW),
+ * 3.1e-6 (FAST_MEDIUM) or 6.3e-7 (FAST_HIGH). A relative error e in the
+ * FastExp2 result moves tanh by at most e / 2, plus 2u for the division
+ */
+template <int P = FAST_MEDIUM> inline float FastTanh(float x) {
+  // past 40 it's 1 to float precision, and 2^(2x log2(e)) stays in range
+  x = fastClamp(x, -40.0f, 40.0f);
+  float t = FastExp2<P>(2.8853901f * x);
+  return (t - 1.0f) / (t + 1.0f);
+}
+
+/**
+ * sin(x), absolute error under 9e-3 (FAST_LOW), 1.5e-4 (FAST_MEDIUM) or
+ * 8.8e-6 (FAST_HIGH) for |x| under 50. The polynomials are off by 4.49e-3,
+ * 6.77e-5 and 6.1e-7, the turns are off by up to 2^-22 from rounding x / 2pi
+ * under 8 and 3.2e-7 from the constant, 3.5e-6 once back in radians. That
+ * grows with x
+ *
+ * @param x Radians, below 1e6 or so
+ */
+template <int P = FAST_MEDIUM> inline float FastSin(float x) {
+  // in turns, folded to -0.5 to 0.5 and then to -0.25 to 0.25 with
+  // sin(pi - a) = sin(a)
+  float r = x * 0.15915494f;
+  r -= fastFloor(r + 0.5f);
+  float above = r > 0.25f;
+  float below = r < -0.25f;
+  r += above * (0.5f - 2.0f * r) + below * (-0.5f - 2.0f * r);
+  return FastPoly<P>::Sin(r);
+}
+
+// cos(x) = sin(x + pi / 2), same error as FastSin
+template <int P = FAST_MEDIUM> inline float FastCos(float x) {
+  return FastSin<P>(x + 1.5707964f);
+}
@@ -1,27 +1,64 @@
 #pragma once
 
+#include "AudioProfiles.hpp"
+#include "FastMath.hpp"
+#include "SpscQueue.hpp"
 #include <daisy_field.h>
 
 using namespace daisy;
 
+// A knob that moved or a switch that was pressed or released, from
+// FieldWrap::ProcessAllControls
+struct ControlEvent {
+  enum Type {
+    KNOB = 0,
+    SWITCH_PRESSED,
+    SWITCH_RELEASED,
+  };
+  Type type;
+  uint8_t index; // knob 0 to 7, switch 1 or 2 (same as SwitchPressed)
+  float value;   // raw knob value, 0 for switches
+};
+
 class FieldWrap {
 public:
   FieldWrap() {}
 
-  void Init(AudioHandle::AudioCallback cb) {
+  void Init(AudioHandle::AudioCallback cb, int profile = AUDIO_HIFI) {
+    callback_ = cb;
     field_.Init();
-    field_.SetAudioBlockSize(16); // not too small
-    field_.SetAudioSampleRate(SaiHandle::Config::SampleRate::SAI_96KHZ);
+    setAudioConfig(profile);
     field_.StartAdc();
     field_.StartAudio(cb);
     // zero LEDs
     field_.led_driver.SwapBuffersAndTransmit();
-    // set all knobs as changed so the values are all read at boot
-    for (size_t i = 0; i < 8; i++) {
-      knobChanged_[i] = true;
+    // out of range so every knob sends an event on the first scan and the
+    // values are all read at boot
+    for (size_t i = 0; i < numKnobs_; i++) {
+      knobValues_[i] = -1.0f;
     }
   }
 
+  /**
+   * AUDIO
+   */
+
+  /**
+   * Stop the audio and switch to another sample rate and block size.
+   * Everything that depends on them has to be set up again before
+   * StartAudio, eg Synth::SetSampleRate and CpuLoadMeter::Init
+   *
+   * @param profile One of AudioProfile
+   */
+  void SetAudioProfile(int profile) {
+    field_.StopAudio();
+    setAudioConfig(profile);
+  }
+  int GetAudioProfile() { return profile_; }
+
+  // Start the callback from Init again, after SetAudioProfile
+  void StartAudio() { field_.StartAudio(callback_); }
+
   /**
    * DISPLAY
    */
@@ -38,8 +75,8 @@ public:
    */
   void PrintToScreen(const char *text, uint8_t x, uint8_t y,
                      bool color = true) {
-    FixedCapStr<16> str(text);
-    PrintFixedCapStrToScreen(str, x, y);
+    field_.display.SetCursor(x, y);
+    field_.display.WriteString(text, Font_6x8, color);
   }
 
   void PrintFixedCapStrToScreen(FixedCapStr<16> text, uint8_t x, uint8_t y,
@@ -48,27 +85,58 @@ public:
     field_.display.WriteString(text, Font_6x8, color);
   }
 
+  // Rectangle from (x1, y1) to (x2, y2), eg for bar graphs
+  void DrawRect(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2,
+                bool fill = true) {
+    field_.display.DrawRect(x1, y1, x2, y2, true, fill);
+  }
+
+  // Blank the rectangle from (x1, y1) to (x2, y2)
+  void ClearRect(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2) {
+    field_.display.DrawRect(x1, y1, x2, y2, false, true);
+  }
+
   /**
    * CONTROLS
    */
 
+  /**
+   * Scan every knob and switch and queue an event for each one that
+   * changed, read them with ControlHasEvents and PopControlEvent.
+   * The switches come first, so a knob moved in the same scan as a switch
+   * that changes what the knobs do gets the new meaning.
+   * A knob only counts as moved when it leaves the hysteresis band around
+   * the value it last sent, so a noisy knob at rest stays quiet
+   */
   void ProcessAllControls() {
     field_.ProcessAllControls();
-    // process knobs, check for tolerance
-    for (size_t i = 0; i < 8; i++) {
-      float tempKnobValue = field_.knob[i].Process();
-      if (tempKnobValue < 0.0f) {
-        tempKnobValue = 0.0f;
+    for (uint8_t i = 1; i <= numSwitches_; i++) {
+      Switch *sw = field_.GetSwitch(i == 1 ? DaisyField::SW_1
+                                           : DaisyField::SW_2);
+      if (sw->RisingEdge()) {
+        pushControlEvent(ControlEvent::SWITCH_PRESSED, i, 0.0f);
+      }
+      if (sw->FallingEdge()) {
+        pushControlEvent(ControlEvent::SWITCH_RELEASED, i, 0.0f);
       }
-      if (fabsf(tempKnobValue - knobValues_[i]) > knobTolerance_) {
-        knobValues_[i] = tempKnobValue;
-        knobChanged_[i] = true;
-        return;
+    }
+    for (size_t i = 0; i < numKnobs_; i++) {
+      float value = field_.knob[i].Value();
+      value = value < 0.0f ? 0.0f : value;
+      if (fabsf(value - knobValues_[i]) > knobHysteresis_) {
+        knobValues_[i] = value;
+        pushControlEvent(ControlEvent::KNOB, i, value);
       }
-      knobChanged_[i] = false;
     }
   }
 
+  bool ControlHasEvents() { return !controlEvents_.IsEmpty(); }
+  ControlEvent PopControlEvent() {
+    ControlEvent event;
+    controlEvents_.Pop(event);
+    return event;
+  }
+
   // switches
 
   bool SwitchPressed(uint8_t i) {
@@ -88,17 +156,16 @@ public:
 
     if (log) {
       // log scale (don't send 0 or lower to this, log doesn't like it)
-      float logMin = logf(minOutput);
-      float logMax = logf(maxOutput);
-      // the power shapes the curve, 1 = normal log scale
-      return expf(logMin + powf(norm, 0.5) * (logMax - logMin));
+      float logMin = FastLog2(minOutput);
+      float logMax = FastLog2(maxOutput);
+      // the square root shapes the curve, norm = normal log scale
+      return FastExp2(logMin + sqrtf(norm) * (logMax - logMin));
     } else {
       // linear scale
       return norm * (maxOutput - minOutput) + minOutput;
     }
   }
 
-  bool DidKnobChange(uint8_t i) { return knobChanged_[i]; }
   float GetKnobValue(uint8_t i) { return knobValues_[i]; }
 
   /**
@@ -115,14 +182,46 @@ public:
 
 private:
   DaisyField field_;
+  AudioHandle::AudioCallback callback_;
+  int profile_;
+
+  void setAudioConfig(int profile) {
+    const AudioProfileConfig &config = GetAudioProfileConfig(profile);
+    profile_ = profile;
+    field_.SetAudioBlockSize(config.blockSize);
+    field_.SetAudioSampleRate(config.sampleRate > 48000.0f
+                                  ? SaiHandle::Config::SampleRate::SAI_96KHZ
+                                  : SaiHandle::Config::SampleRate::SAI_48KHZ);
+  }
+
+  static constexpr size_t numKnobs_ = 8;
+  static constexpr uint8_t numSwitches_ = 2;
 
   // knobs
-  const float knobTolerance_ = 0.001f;
+  const float knobHysteresis_ = 0.001f;
   // the knobs are not actually from 0 to 1
   // getting the real values for each knob is annoying
   // so I picked safe values
   const float minKnob_ = 0.001f;
   const float maxKnob_ = 0.967f;
-  float knobValues_[8];
-  bool knobChanged_[8];
+  float knobValues_[numKnobs_]; // the values last sent
+
+  // a scan queues at most one event per knob and switch, a debounced switch
+  // only has one edge per scan
+  static constexpr size_t maxScanEvents_ = numKnobs_ + numSwitches_;
+  // scans the queue holds if the main loop falls behind
+  static constexpr size_t controlQueueScans_ = 3;
+  // lock free so the audio callback could read it too
+  SpscQueue<ControlEvent,
+            SpscQueueSize(maxScanEvents_ * controlQueueScans_)>
+      controlEvents_;
+
+  void pushControlEvent(ControlEvent::Type type, uint8_t index,
+                        float value) {
+    ControlEvent event;
+    event.type = type;
+    event.index = index;
+    event.value = value;
+    controlEvents_.Push(event);
+  }
 };
\ No newline at end of file
@@ -1,19 +1,118 @@
 #include "Filter.hpp"
+#include "FastMath.hpp"
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#ifdef __arm__
+#include "daisy_core.h" // DTCM_MEM_SECTION
+#else
+#include <cstdio>
+#define DTCM_MEM_SECTION
+#endif
+
+// the frequency tables in use, in the tightly coupled memory next to the
+// core so the lookups every sample don't go through the cache. Every filter
+// holds a slot for each of its 1x, 2x and 4x rates from Init on, a slot
+// nobody holds keeps its table until another rate needs the room. 6 is two
+// sample rates with all of their oversampling rates at once
+#define FILTER_CACHED_RATES 6
+static FilterFreqTable cachedTables[FILTER_CACHED_RATES] DTCM_MEM_SECTION;
+static float cachedRates[FILTER_CACHED_RATES];
+static int cachedRefs[FILTER_CACHED_RATES];
+// the Q table is the same for every rate, made at the first Init
+static FilterQCoeffs qTable[FILTER_Q_STEPS] DTCM_MEM_SECTION;
+static bool qTableMade = false;
+
+// filters at more rates than there are slots, stop rather than overwrite a
+// table that is playing
+static void outOfTableSlots(float sr) {
+#ifndef __arm__
+  fprintf(stderr, "filter: no coefficient table slot left for %g Hz, "
+                  "raise FILTER_CACHED_RATES\n",
+          sr);
+#endif
+  abort();
+}
+
+// a slot with the table for sr, copied from the generated one or worked
+// out when there isn't one. Not from the audio callback
+static int holdTable(float sr) {
+  int free = -1;
+  for (int i = 0; i < FILTER_CACHED_RATES; i++) {
+    if (cachedRates[i] == sr) {
+      cachedRefs[i]++;
+      return i;
+    }
+    free = free < 0 && cachedRefs[i] == 0 ? i : free;
+  }
+  if (free < 0) {
+    outOfTableSlots(sr);
+  }
+  FilterFreqCoeffs *table = cachedTables[free];
+  const FilterFreqTable *generated = nullptr;
+  for (int i = 0; i < numFilterTables; i++) {
+    if (filterTables[i].sr == sr) {
+      generated = filterTables[i].table;
+    }
+  }
+  if (generated) {
+    std::copy(*generated, *generated + FILTER_FREQ_STEPS, table);
+  } else {
+    // not generated for this rate, slower but only happens once
+    for (int f = 0; f < FILTER_FREQ_STEPS; ++f) {
+      table[f] = CalcFilterFreqCoeffs(f, sr);
+    }
+  }
+  cachedRates[free] = sr;
+  cachedRefs[free] = 1;
+  return free;
+}
 
-Filter::FilterCoeffs Filter::coeffTable_[Filter::coeffQSteps_]
-                                        [Filter::coeffFreqSteps_];
+static void releaseTable(int slot) {
+  if (slot >= 0) {
+    cachedRefs[slot]--;
+  }
+}
+
+template <typename T> FilterT<T>::FilterT() {
+  for (int i = 0; i < 3; i++) {
+    tableSlots_[i] = -1;
+  }
+}
 
-void Filter::Init(float sr) {
+template <typename T> FilterT<T>::~FilterT() {
+  for (int i = 0; i < 3; i++) {
+    releaseTable(tableSlots_[i]);
+  }
+}
+
+template <typename T> void FilterT<T>::Init(float sr) {
   sr_ = sr;
+  // 1x, 2x and 4x, SetOversampling only picks one. The new ones are held
+  // before the old ones go so a rate both use isn't copied again
+  int slots[3];
+  for (int i = 0; i < 3; i++) {
+    slots[i] = holdTable(sr * (1 << i));
+  }
+  for (int i = 0; i < 3; i++) {
+    releaseTable(tableSlots_[i]);
+    tableSlots_[i] = slots[i];
+  }
+  if (!qTableMade) {
+    for (int q = 0; q < coeffQSteps_; q++) {
+      qTable[q] = CalcFilterQCoeffs(q);
+    }
+    qTableMade = true;
+  }
   freqIndex_ = 0.5f;
+  lastFreqIndex_ = freqIndex_;
   addFreqIndex_ = 0.0f;
   qIndex_ = 0.2f;
-  out_ = 0.0f;
 
   // main filter
-  y0_ = 0.0f;
   y1_ = 0.0f;
   y2_ = 0.0f;
   y3_ = 0.0f;
@@ -31,17 +130,9 @@ void Filter::Init(float sr) {
   y1n_ = 0.0f;
   y2n_ = 0.0f;
 
-  twoPiOverSampleRate = 2.0 * M_PI / sr_;
-
-  // feedback highpass coefficients
-  // it's always at 150Hz so we only need one set of coefficients
-  float x = exp(-2.0 * M_PI * 150.0f * (1.0f / sr_));
-  b0hp_ = 0.5 * (1 + x);
-  b1hp_ = -0.5 * (1 + x);
-  a1hp_ = x;
-
   // allpass coefficients
   // always at 14.008Hz
+  float x = exp(-2.0 * M_PI * 150.0f * (1.0f / sr_));
   float y = exp(-2.0 * M_PI * 14.008f * (1.0f / sr_));
   b0ap_ = 0.5 * (1 + x);
   b1ap_ = -0.5 * (1 + x);
@@ -60,176 +151,221 @@ void Filter::Init(float sr) {
   b1n_ = -2.0 * c * scale;
   b2n_ = 1.0 * scale;
 
-  InitLookupTable();
+  SetOversampling(1);
 }
 
-float Filter::Process(float in) {
-
-  FilterCoeffs coeffs =
-      GetInterpolatedCoeffs(freqIndex_ + addFreqIndex_, qIndex_);
-
-  float tmp = in;
+template <typename T> void FilterT<T>::SetOversampling(int factor) {
+  oversampling_ = factor >= 4 ? 4 : (factor >= 2 ? 2 : 1);
+  up1_.Init();
+  up2_.Init();
+  down1_.Init();
+  down2_.Init();
+  float rate = sr_ * oversampling_;
+  calcHighpass(rate);
+  freqTable_ = cachedTables[tableSlots_[oversampling_ >> 1]];
+}
 
-  // feedback highpass
-  float hpin = coeffs.k * shape(y4_);
-  y1hp_ = b0hp_ * hpin + b1hp_ * x1hp_ + a1hp_ * y1hp_ + FLT_MIN;
-  x1hp_ = hpin;
+template <typename T> int FilterT<T>::GetOversampling() {
+  return oversampling_;
+}
 
-  // main filter
-  y0_ = -tmp - y1hp_;
-  y1_ += 2 * coeffs.b0 * (y0_ - y1_ + y2_);
-  y2_ += coeffs.b0 * (y1_ - 2 * y2_ + y3_);
-  y3_ += coeffs.b0 * (y2_ - 2 * y3_ + y4_);
-  y4_ += coeffs.b0 * (y3_ - 2 * y4_);
-  tmp = 2 * coeffs.g * y4_;
+template <typename T> void FilterT<T>::calcHighpass(float rate) {
+  // feedback highpass coefficients
+  // it's always at 150Hz so we only need one set of coefficients
+  float x = exp(-2.0 * M_PI * 150.0f * (1.0f / rate));
+  b0hp_ = 0.5 * (1 + x);
+  b1hp_ = -0.5 * (1 + x);
+  a1hp_ = x;
+}
 
-  // allpass
-  float apin = tmp;
-  y1ap_ = b0ap_ * apin + b1ap_ * x1ap_ + a1ap_ * y1ap_ + FLT_MIN;
-  x1ap_ = apin;
-  tmp = y1ap_;
+template <typename T> T FilterT<T>::Process(T in) {
+  ProcessBlock(&in, &addFreqIndex_, 1);
+  return in;
+}
 
-  // biquad notch
-  float y = b0n_ * tmp + b1n_ * x1n_ + b2n_ * x2n_ + a1n_ * y1n_ + a2n_ * y2n_ +
-            FLT_MIN;
-  x2n_ = x1n_;
-  x1n_ = tmp;
-  y2n_ = y1n_;
-  y1n_ = y;
-  tmp = y;
+template <typename T>
+void FilterT<T>::ProcessBlock(T *buf, const float *addFreq, size_t size) {
+  // copy the state to locals so it stays in registers for the whole block
+  T y1 = y1_, y2 = y2_, y3 = y3_, y4 = y4_;
+  T y1hp = y1hp_, x1hp = x1hp_;
+  T y1ap = y1ap_, x1ap = x1ap_;
+  T x1n = x1n_, x2n = x2n_, y1n = y1n_, y2n = y2n_;
+
+  // one sample (or stereo pair) through the whole chain at the core rate
+  auto core = [&](T in, float b0, float k,
+                  float g) __attribute__((always_inline)) {
+    // feedback highpass
+    T hpin = k * shape(y4);
+    y1hp = b0hp_ * hpin + b1hp_ * x1hp + a1hp_ * y1hp + FLT_MIN;
+    x1hp = hpin;
+
+    // main filter
+    T y0 = T(0.0f) - in - y1hp;
+    y1 += 2 * b0 * (y0 - y1 + y2);
+    y2 += b0 * (y1 - 2 * y2 + y3);
+    y3 += b0 * (y2 - 2 * y3 + y4);
+    y4 += b0 * (y3 - 2 * y4);
+    return 2 * g * y4;
+  };
+
+  // allpass and notch after the main filter, they're linear so they stay at
+  // the outside rate when the core is oversampled
+  auto post = [&](T tmp) __attribute__((always_inline)) {
+    // allpass
+    y1ap = b0ap_ * tmp + b1ap_ * x1ap + a1ap_ * y1ap + FLT_MIN;
+    x1ap = tmp;
+    tmp = y1ap;
+
+    // biquad notch
+    T y = b0n_ * tmp + b1n_ * x1n + b2n_ * x2n + a1n_ * y1n + a2n_ * y2n +
+          FLT_MIN;
+    x2n = x1n;
+    x1n = tmp;
+    y2n = y1n;
+    y1n = y;
+    return y;
+  };
+
+  // one sample at the outside rate, same coefficients for the oversampled
+  // ones in between
+  auto tick = [&](T in, float b0, float k,
+                  float g) __attribute__((always_inline)) {
+    if (oversampling_ == 1) {
+      return post(core(in, b0, k, g));
+    }
+    T a0, a1;
+    up1_.Process(in, a0, a1);
+    if (oversampling_ == 2) {
+      a0 = core(a0, b0, k, g);
+      a1 = core(a1, b0, k, g);
+      return post(down1_.Process(a0, a1));
+    }
+    T c0, c1, c2, c3;
+    up2_.Process(a0, c0, c1);
+    up2_.Process(a1, c2, c3);
+    c0 = core(c0, b0, k, g);
+    c1 = core(c1, b0, k, g);
+    c2 = core(c2, b0, k, g);
+    c3 = core(c3, b0, k, g);
+    return post(
+        down1_.Process(down2_.Process(c0, c1), down2_.Process(c2, c3)));
+  };
+
+  // a SetFreq since the last block slides in over this one instead of
+  // jumping, freq(i) is the frequency index at sample i
+  const float freqStart = lastFreqIndex_;
+  const float freqInc = size > 0 ? (freqIndex_ - freqStart) / size : 0.0f;
+  auto freq = [&](size_t i) __attribute__((always_inline)) {
+    return freqStart + freqInc * (i + 1);
+  };
+  // Q doesn't move within a block, only the frequency row is read per
+  // lookup
+  const FilterQCoeffs qc = qCoeffs(qIndex_);
+  auto lookup = [&](float freqIndex) __attribute__((always_inline)) {
+    return CombineFilterCoeffs(freqCoeffs(freqIndex), qc);
+  };
+
+  for (size_t i = 0; i < size; i++) {
+    FilterCoeffs c = lookup(freq(i) + addFreq[i]);
+    buf[i] = tick(buf[i], c.b0, c.k, c.g);
+  }
 
-  return tmp;
+  y1_ = y1;
+  y2_ = y2;
+  y3_ = y3;
+  y4_ = y4;
+  y1hp_ = y1hp;
+  x1hp_ = x1hp;
+  y1ap_ = y1ap;
+  x1ap_ = x1ap;
+  x1n_ = x1n;
+  x2n_ = x2n;
+  y1n_ = y1n;
+  y2n_ = y2n;
+  if (size > 0) {
+    addFreqIndex_ = addFreq[size - 1];
+    lastFreqIndex_ = freqIndex_;
+  }
 }
 
-float Filter::shape(float x) {
-  x = (x < -SQRT2) ? -SQRT2 : (x > SQRT2 ? SQRT2 : x);
+template <typename T> T FilterT<T>::shape(T x) {
+  x = Min(Max(x, T(-SQRT2)), T(SQRT2));
   return x - r6_ * x * x * x;
 }
 
-float Filter::lerp(float a, float b, float t) { return a + t * (b - a); }
+template <typename T> float FilterT<T>::lerp(float a, float b, float t) {
+  return a + t * (b - a);
+}
 
-void Filter::SetFreq(float freqIndex) {
+template <typename T> void FilterT<T>::SetFreq(float freqIndex) {
   // not clamping here because it already happens in GetNearestCoeffs
   freqIndex_ = freqIndex;
 }
 
-void Filter::AddFreq(float freqIndex) {
+template <typename T> void FilterT<T>::AddFreq(float freqIndex) {
   // not clamping here because it already happens in GetNearestCoeffs
   addFreqIndex_ = freqIndex;
 }
 
-void Filter::SetQ(float qIndex) {
+template <typename T> void FilterT<T>::SetQ(float qIndex) {
   // not clamping here because it already happens in GetNearestCoeffs
   qIndex_ = qIndex;
 }
 
-float Filter::GetFreq() {
-  float freq = minFreq_ * powf(maxFreq_ / minFreq_, freqIndex_);
-  return freq;
-}
-float Filter::GetQ() { return minQ_ + (maxQ_ - minQ_) * qIndex_; }
-
-void Filter::InitLookupTable() {
-  for (int qIndex = 0; qIndex < coeffQSteps_; ++qIndex) {
-    float q = minQ_ + (maxQ_ - minQ_) * (float(qIndex) / (coeffQSteps_ - 1));
-
-    for (int freqIndex = 0; freqIndex < coeffFreqSteps_; ++freqIndex) {
-      float fT = float(freqIndex) / (coeffFreqSteps_ - 1);
-      float freq = minFreq_ * powf(maxFreq_ / minFreq_, fT);
-
-      float wc = twoPiOverSampleRate * freq;
-      float wc2 = wc * wc;
-      float r = (1.0 - exp(-3.0 * q)) / (1.0 - exp(-3.0));
-
-      float pa12 = -1.341281325101042e-02;
-      float pa11 = 8.168739417977708e-02;
-      float pa10 = -2.365036766021623e-01;
-      float pa09 = 4.439739664918068e-01;
-      float pa08 = -6.297350825423579e-01;
-      float pa07 = 7.529691648678890e-01;
-      float pa06 = -8.249882473764324e-01;
-      float pa05 = 8.736418933533319e-01;
-      float pa04 = -9.164580250284832e-01;
-      float pa03 = 9.583192455599817e-01;
-      float pa02 = -9.999994950291231e-01;
-
-      float tmp = wc2 * pa12 + pa11 * wc + pa10;
-      tmp = wc2 * tmp + pa09 * wc + pa08;
-      tmp = wc2 * tmp + pa07 * wc + pa06;
-      tmp = wc2 * tmp + pa05 * wc + pa04;
-      tmp = wc2 * tmp + pa03 * wc + pa02;
-
-      float pr8 = -4.554677015609929e-05;
-      float pr7 = -2.022131730719448e-05;
-      float pr6 = 2.784706718370008e-03;
-      float pr5 = 2.079921151733780e-03;
-      float pr4 = -8.333236384240325e-02;
-      float pr3 = -1.666668203490468e-01;
-      float pr2 = 1.000000012124230e+00;
-      float pr1 = 3.999999999650040e+00;
-      float pr0 = 4.000000000000113e+00;
-      tmp = wc2 * pr8 + pr7 * wc + pr6;
-      tmp = wc2 * tmp + pr5 * wc + pr4;
-      tmp = wc2 * tmp + pr3 * wc + pr2;
-      tmp = wc2 * tmp + pr1 * wc + pr0;
-      float k = r * tmp;
-      float g = 1.0;
-
-      float fx = wc * ONE_OVER_SQRT2 / (2 * M_PI);
-      float b0 = (0.00045522346 + 6.1922189 * fx) /
-                 (1.0 + 12.358354 * fx + 4.4156345 * (fx * fx));
-      k = fx * (fx * (fx * (fx * (fx * (fx + 7198.6997) - 5837.7917) -
-                            476.47308) +
-                      614.95611) +
-                213.87126) +
-          16.998792;
-      g = k * 0.058823529411764705882352941176471;
-      g = (g - 1.0) * r + 1.0;
-      g = (g * (1.0 + r));
-      k = k * r;
-
-      coeffTable_[qIndex][freqIndex].b0 = b0;
-      coeffTable_[qIndex][freqIndex].k = k;
-      coeffTable_[qIndex][freqIndex].g = g;
-    }
-  }
+template <typename T> float FilterT<T>::GetFreq() {
+  return IndexToFreq(freqIndex_);
 }
+template <typename T> float FilterT<T>::GetQ() { return IndexToQ(qIndex_); }
 
-Filter::FilterCoeffs Filter::GetInterpolatedCoeffs(float freq, float res) {
+template <typename T> float FilterT<T>::IndexToFreq(float freqIndex) {
+  // the log2 of the constants folds away
+  return FILTER_MIN_FREQ *
+         FastExp2(freqIndex * log2f(FILTER_MAX_FREQ / FILTER_MIN_FREQ));
+}
+template <typename T> float FilterT<T>::IndexToQ(float qIndex) {
+  return FILTER_MIN_Q + (FILTER_MAX_Q - FILTER_MIN_Q) * qIndex;
+}
+
+template <typename T>
+FilterFreqCoeffs FilterT<T>::freqCoeffs(float freq) {
   // clamp is necessary because envelope makes freq go above 1
   freq = (freq < 0) ? 0 : (freq > 1.0f ? 1.0f : freq);
-  res = (res < 0) ? 0 : (res > 1.0f ? 1.0f : res);
-
   float f = freq * (coeffFreqSteps_ - 1);
-  float q = res * (coeffQSteps_ - 1);
   uint16_t f0 = (int)floorf(f);
-  uint16_t q0 = (int)floorf(q);
   uint16_t f1 = f0 + 1;
-  uint16_t q1 = q0 + 1;
   float tf = f - f0;
-  float tq = q - q0;
-
   if (f0 >= coeffFreqSteps_ - 1) {
     f0 = f1 = coeffFreqSteps_ - 1;
     tf = 0.0f;
   }
+  const FilterFreqCoeffs &c0 = freqTable_[f0];
+  const FilterFreqCoeffs &c1 = freqTable_[f1];
+  FilterFreqCoeffs coeffs = {lerp(c0.b0, c1.b0, tf), lerp(c0.kf, c1.kf, tf),
+                             lerp(c0.gf, c1.gf, tf)};
+  return coeffs;
+}
+
+template <typename T> FilterQCoeffs FilterT<T>::qCoeffs(float res) {
+  res = (res < 0) ? 0 : (res > 1.0f ? 1.0f : res);
+  float q = res * (coeffQSteps_ - 1);
+  uint16_t q0 = (int)floorf(q);
+  uint16_t q1 = q0 + 1;
+  float tq = q - q0;
   if (q0 >= coeffQSteps_ - 1) {
     q0 = q1 = coeffQSteps_ - 1;
     tq = 0.0f;
   }
-
-  float b00 = lerp(coeffTable_[q0][f0].b0, coeffTable_[q0][f1].b0, tf);
-  float b01 = lerp(coeffTable_[q1][f0].b0, coeffTable_[q1][f1].b0, tf);
-  float b0 = lerp(b00, b01, tq);
-
-  float k0 = lerp(coeffTable_[q0][f0].k, coeffTable_[q0][f1].k, tf);
-  float k1 = lerp(coeffTable_[q1][f0].k, coeffTable_[q1][f1].k, tf);
-  float k = lerp(k0, k1, tq);
-
-  float g0 = lerp(coeffTable_[q0][f0].g, coeffTable_[q0][f1].g, tf);
-  float g1 = lerp(coeffTable_[q1][f0].g, coeffTable_[q1][f1].g, tf);
-  float g = lerp(g0, g1, tq);
-
-  FilterCoeffs coeffs = {b0, k, g};
+  const FilterQCoeffs &c0 = qTable[q0];
+  const FilterQCoeffs &c1 = qTable[q1];
+  FilterQCoeffs coeffs = {lerp(c0.r, c1.r, tq), lerp(c0.a, c1.a, tq),
+                          lerp(c0.c, c1.c, tq)};
   return coeffs;
 }
+
+template <typename T>
+FilterCoeffs FilterT<T>::GetInterpolatedCoeffs(float freq, float res) {
+  return CombineFilterCoeffs(freqCoeffs(freq), qCoeffs(res));
+}
+
+template class FilterT<float>;
+template class FilterT<Float2>;
@@ -1,21 +1,39 @@
 #pragma once
 
+#include "FilterCoeffs.hpp"
+#include "Halfband.hpp"
+#include "Simd.hpp"
 #include <cmath>
+#include <cstddef>
 
 #define SQRT2 1.4142135623730950488016887242097
-#define ONE_OVER_SQRT2 0.70710678118654752440084436210485
 
-class Filter {
+// T is the sample type, float for one channel or Float2 for a stereo pair
+// (see Filter and StereoFilter below), the coefficients are looked up once
+// for all channels
+template <typename T> class FilterT {
 public:
-  Filter() {}
-  ~Filter() {}
+  FilterT();
+  ~FilterT();
+  // a copy would hold the same table slots
+  FilterT(const FilterT &) = delete;
+  FilterT &operator=(const FilterT &) = delete;
 
-  // Call before using
+  // Call before using, also gets the coefficient tables for every
+  // oversampling factor ready, so not from the audio callback
   void Init(float sr);
   // Get next sample
-  float Process(float in);
+  T Process(T in);
+  // Filter a buffer in place, addFreq is the AddFreq value for each sample
+  void ProcessBlock(T *buf, const float *addFreq, size_t size);
 
-  // Set frequency index (0 to 1)
+  // Run the filter at factor (1, 2 or 4) times the sample rate, the shaper
+  // in the feedback loop aliases less. The tables are ready from Init, so
+  // it only resets the resampling and is fine from the audio callback
+  void SetOversampling(int factor);
+  int GetOversampling();
+
+  // Set frequency index (0 to 1), it slides there over the next block
   void SetFreq(float freq);
   // Set Q index (0 to 1)
   void SetQ(float q);
@@ -24,38 +42,57 @@ public:
 
   float GetFreq();
   float GetQ();
+  // what the indexes mean, Hz and resonance
+  static float IndexToFreq(float freqIndex);
+  static float IndexToQ(float qIndex);
+
+  // Coefficients from the table for a frequency and Q index, what
+  // ProcessBlock looks up every sample (public for the benchmarks)
+  FilterCoeffs GetInterpolatedCoeffs(float freqIndex, float qIndex);
 
 private:
-  const float minFreq_ = 200.0f;
-  const float maxFreq_ = 20000.0f;
-  const float minQ_ = 0.0f;
-  const float maxQ_ = 0.95f;
-  float sr_, freqIndex_, addFreqIndex_, qIndex_, out_;
-  float twoPiOverSampleRate;
-
-  float y0_, y1_, y2_, y3_, y4_;           // for main filter
-  float y1hp_, x1hp_, b0hp_, b1hp_, a1hp_; // for feedback highpass
-  float y1ap_, x1ap_, b0ap_, b1ap_, a1ap_; // for allpass
-  float b0n_, b1n_, b2n_, x1n_, x2n_, y1n_, y2n_, a1n_, a2n_; // notch
+  float sr_, freqIndex_, addFreqIndex_, qIndex_;
+  // freqIndex_ at the end of the last block, for the slide to a new one
+  float lastFreqIndex_;
+
+  T y1_, y2_, y3_, y4_;               // for main filter
+  T y1hp_, x1hp_;                     // for feedback highpass
+  T y1ap_, x1ap_;                     // for allpass
+  T x1n_, x2n_, y1n_, y2n_;           // for notch
+  float b0hp_, b1hp_, a1hp_;          // feedback highpass coefficients
+  float b0ap_, b1ap_, a1ap_;          // allpass coefficients
+  float b0n_, b1n_, b2n_, a1n_, a2n_; // notch coefficients
 
   const float r6_ = 1.0 / 6.0;
-  float shape(float x);
+  T shape(T x);
+
+  // oversampling, the second stage is only used at 4x
+  int oversampling_;
+  UpsamplerT<T> up1_, up2_;
+  DownsamplerT<T> down1_, down2_;
+
+  // feedback highpass coefficients for the rate the core runs at
+  void calcHighpass(float rate);
 
   // linear interpolation
   inline float lerp(float a, float b, float t);
 
-  // filter coefficients lookup table
+  // filter coefficients lookup tables, see FilterCoeffs.hpp
   // lookup table size
-  static constexpr int coeffFreqSteps_ = 384;
-  static constexpr int coeffQSteps_ = 64;
-  // table struct
-  struct FilterCoeffs {
-    float b0, k, g;
-  };
-  // table
-  static FilterCoeffs coeffTable_[coeffQSteps_][coeffFreqSteps_];
-  // generate lookup table
-  void InitLookupTable();
-  // get coefficients from index
-  FilterCoeffs GetInterpolatedCoeffs(float freqIndex, float qIndex);
-};
\ No newline at end of file
+  static constexpr int coeffFreqSteps_ = FILTER_FREQ_STEPS;
+  static constexpr int coeffQSteps_ = FILTER_Q_STEPS;
+  // frequency table for the rate the core runs at, shared by all filters
+  const FilterFreqCoeffs *freqTable_;
+  // table slots in DTCM held for 1x, 2x and 4x (see Filter.cpp), -1 when
+  // there's none
+  int tableSlots_[3];
+  // both parts interpolated, inlined into the per sample loops
+  inline FilterFreqCoeffs freqCoeffs(float freqIndex)
+      __attribute__((always_inline));
+  inline FilterQCoeffs qCoeffs(float qIndex) __attribute__((always_inline));
+};
+
+// the instances are in Filter.cpp
+typedef FilterT<float> Filter;
+// left and right in the two lanes
+typedef FilterT<Float2> StereoFilter;
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cmath>
+
+// Filter coefficient lookup tables
+//
+// The coefficients split into a frequency part and a resonance part:
+//   b0 = b0f
+//   k = kf * r
+//   g = (1 + r) + r * (1 + r) * gf, with gf = kf / 17 - 1
+// so there is one row per frequency step for each sample rate
+// (FILTER_FREQ_STEPS * 3 floats, 4.5KB) and one small row for the Q steps
+// shared by all rates. Interpolating each row and combining them gives the
+// same coefficients as interpolating a whole 2-D table.
+// The frequency rows are generated on the computer at build time by
+// host/GenFilterTables.cpp (one per rate in FILTER_TABLE_RATES, see the
+// Makefile), Filter.cpp copies the ones in use to DTCM.
+
+#define ONE_OVER_SQRT2 0.70710678118654752440084436210485
+
+// lookup table size
+#define FILTER_FREQ_STEPS 384
+#define FILTER_Q_STEPS 64
+// lookup table range, the frequency steps are exponential
+#define FILTER_MIN_FREQ 200.0f
+#define FILTER_MAX_FREQ 20000.0f
+#define FILTER_MIN_Q 0.0f
+#define FILTER_MAX_Q 0.95f
+
+struct FilterCoeffs {
+  float b0, k, g;
+};
+
+// one frequency step, k and g before the resonance goes in
+struct FilterFreqCoeffs {
+  float b0, kf, gf;
+};
+
+// one Q step, r and the two factors of g
+struct FilterQCoeffs {
+  float r, a, c; // r, 1 + r, r * (1 + r)
+};
+
+typedef FilterFreqCoeffs FilterFreqTable[FILTER_FREQ_STEPS];
+
+// A generated table and the sample rate it was made for
+struct FilterTableEntry {
+  float sr;
+  const FilterFreqTable *table;
+};
+
+// in the generated FilterTables.cpp
+extern const FilterTableEntry filterTables[];
+extern const int numFilterTables;
+
+/**
+ * Frequency part of the coefficients
+ *
+ * @param freqIndex Frequency step (0 to FILTER_FREQ_STEPS - 1)
+ * @param sr Sample rate
+ */
+inline FilterFreqCoeffs CalcFilterFreqCoeffs(int freqIndex, float sr) {
+  float fT = float(freqIndex) / (FILTER_FREQ_STEPS - 1);
+  float freq = FILTER_MIN_FREQ * powf(FILTER_MAX_FREQ / FILTER_MIN_FREQ, fT);
+
+  float twoPiOverSampleRate = 2.0 * M_PI / sr;
+  float wc = twoPiOverSampleRate * freq;
+  float fx = wc * ONE_OVER_SQRT2 / (2 * M_PI);
+  float b0 = (0.00045522346 + 6.1922189 * fx) /
+             (1.0 + 12.358354 * fx + 4.4156345 * (fx * fx));
+  float k =
+      fx * (fx * (fx * (fx * (fx * (fx + 7198.6997) - 5837.7917) - 476.47308) +
+                  614.95611) +
+            213.87126) +
+      16.998792;
+  float g = k * 0.058823529411764705882352941176471 - 1.0;
+
+  FilterFreqCoeffs coeffs = {b0, k, g};
+  return coeffs;
+}
+
+/**
+ * Resonance part of the coefficients
+ *
+ * @param qIndex Q step (0 to FILTER_Q_STEPS - 1)
+ */
+inline FilterQCoeffs CalcFilterQCoeffs(int qIndex) {
+  float q = FILTER_MIN_Q + (FILTER_MAX_Q - FILTER_MIN_Q) *
+                               (float(qIndex) / (FILTER_Q_STEPS - 1));
+  float r = (1.0 - exp(-3.0 * q)) / (1.0 - exp(-3.0));
+
+  FilterQCoeffs coeffs = {r, 1.0f + r, r * (1.0f + r)};
+  return coeffs;
+}
+
+// The coefficients from both parts
+inline FilterCoeffs CombineFilterCoeffs(const FilterFreqCoeffs &f,
+                                        const FilterQCoeffs &q) {
+  FilterCoeffs coeffs = {f.b0, f.kf * q.r, q.a + q.c * f.gf};
+  return coeffs;
+}
+
+/**
+ * Coefficients for one frequency and Q step
+ *
+ * @param freqIndex Frequency step (0 to FILTER_FREQ_STEPS - 1)
+ * @param qIndex Q step (0 to FILTER_Q_STEPS - 1)
+ * @param sr Sample rate
+ */
+inline FilterCoeffs CalcFilterCoeffs(int freqIndex, int qIndex, float sr) {
+  return CombineFilterCoeffs(CalcFilterFreqCoeffs(freqIndex, sr),
+                             CalcFilterQCoeffs(qIndex));
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+
+// Text in a fixed buffer, for building display strings without the heap.
+// Holds up to N characters, anything past that is cut off
+template <size_t N> class FixedText {
+public:
+  FixedText() { Clear(); }
+  FixedText(const char *text) { Set(text); }
+
+  void Clear() {
+    size_ = 0;
+    text_[0] = '\0';
+  }
+
+  void Set(const char *text) {
+    Clear();
+    Append(text);
+  }
+
+  FixedText &Append(const char *text) {
+    while (*text && size_ < N) {
+      text_[size_++] = *text++;
+    }
+    text_[size_] = '\0';
+    return *this;
+  }
+
+  FixedText &Append(char c) {
+    if (size_ < N) {
+      text_[size_++] = c;
+      text_[size_] = '\0';
+    }
+    return *this;
+  }
+
+  // Decimal, with a minus sign when negative
+  FixedText &AppendInt(int value) {
+    // digits come out backwards, unsigned so the lowest int works too
+    unsigned int u = value < 0 ? 0u - unsigned(value) : unsigned(value);
+    char digits[12];
+    int n = 0;
+    do {
+      digits[n++] = '0' + u % 10;
+      u /= 10;
+    } while (u > 0);
+    if (value < 0) {
+      Append('-');
+    }
+    while (n > 0) {
+      Append(digits[--n]);
+    }
+    return *this;
+  }
+
+  const char *Get() const { return text_; }
+  size_t Size() const { return size_; }
+
+  bool operator==(const char *text) const {
+    size_t i = 0;
+    for (; i < size_ && text[i]; i++) {
+      if (text_[i] != text[i]) {
+        return false;
+      }
+    }
+    return i == size_ && text[i] == '\0';
+  }
+  bool operator!=(const char *text) const { return !(*this == text); }
+
+private:
+  char text_[N + 1];
+  size_t size_;
+};
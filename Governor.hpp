@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+
+// Steps the DSP quality down before the audio callback runs out of time,
+// and back up once there's room again
+//
+// It gets the load of every block (time taken over the block period). One
+// block over GOVERNOR_HIGH steps down a tier right away, then it waits a
+// window for the cheaper tier to show before it can step again. It only
+// steps back up after GOVERNOR_HOLD windows in a row with every block under
+// GOVERNOR_LOW. A tier that goes straight back over the top doubles the
+// hold, so a patch that sits between two tiers doesn't keep flipping.
+// What a tier takes away is up to the caller, see Synth::SetQuality
+
+#define GOVERNOR_HIGH 0.85f   // a block over this steps down
+#define GOVERNOR_LOW 0.6f     // every block under this to step up
+#define GOVERNOR_WINDOW 0.1f  // seconds
+#define GOVERNOR_HOLD 10      // windows, 1 second
+#define GOVERNOR_MAX_HOLD 160 // windows the hold doubles up to
+
+class Governor {
+public:
+  /**
+   * @param blockRate Blocks per second, for the window length
+   * @param numTiers Tier 0 is full quality, numTiers - 1 the cheapest
+   */
+  void Init(float blockRate, int numTiers) {
+    windowBlocks_ = static_cast<size_t>(blockRate * GOVERNOR_WINDOW);
+    windowBlocks_ = windowBlocks_ < 1 ? 1 : windowBlocks_;
+    numTiers_ = numTiers;
+    tier_ = 0;
+    hold_ = GOVERNOR_HOLD;
+    blocks_ = 0;
+    windowMax_ = 0.0f;
+    lastMax_ = 0.0f;
+    settle_ = 0;
+    quiet_ = 0;
+    sinceUp_ = GOVERNOR_MAX_HOLD;
+  }
+
+  /**
+   * Add a block
+   *
+   * @param load Time the block took over the block period
+   * @return True when the tier changed, GetTier has the new one
+   */
+  bool Process(float load) {
+    windowMax_ = load > windowMax_ ? load : windowMax_;
+    bool changed = false;
+    if (load > GOVERNOR_HIGH && settle_ == 0 && tier_ < numTiers_ - 1) {
+      tier_++;
+      settle_ = windowBlocks_;
+      quiet_ = 0;
+      // stepped up too early, wait longer next time
+      if (sinceUp_ < hold_) {
+        hold_ = hold_ * 2 > GOVERNOR_MAX_HOLD ? GOVERNOR_MAX_HOLD : hold_ * 2;
+      }
+      sinceUp_ = GOVERNOR_MAX_HOLD;
+      changed = true;
+    }
+    settle_ = settle_ > 0 ? settle_ - 1 : 0;
+    if (++blocks_ < windowBlocks_) {
+      return changed;
+    }
+
+    // a whole window
+    lastMax_ = windowMax_;
+    quiet_ = windowMax_ < GOVERNOR_LOW ? quiet_ + 1 : 0;
+    blocks_ = 0;
+    windowMax_ = 0.0f;
+    if (sinceUp_ < GOVERNOR_MAX_HOLD) {
+      // a step up that held on as long as the hold was fine
+      if (++sinceUp_ == hold_) {
+        hold_ = GOVERNOR_HOLD;
+      }
+    }
+    if (quiet_ >= hold_ && tier_ > 0 && !changed) {
+      tier_--;
+      quiet_ = 0;
+      sinceUp_ = 0;
+      changed = true;
+    }
+    return changed;
+  }
+
+  int GetTier() { return tier_; }
+  // worst block in the last whole window
+  float GetMaxLoad() { return lastMax_; }
+  // windows under GOVERNOR_LOW it takes to step up now
+  int GetHold() { return hold_; }
+
+private:
+  size_t windowBlocks_, blocks_;
+  int numTiers_, tier_;
+  float windowMax_, lastMax_;
+  size_t settle_; // blocks before it can step down again
+  int quiet_;     // windows in a row under GOVERNOR_LOW
+  int hold_;      // windows of quiet_ to step up
+  int sinceUp_;   // windows since stepping up, the max once it stepped down
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "Simd.hpp"
+#include <cmath>
+
+// Polyphase halfband FIR for 2x up and downsampling
+//
+// A halfband filter has every other tap at zero except the center one, so
+// each polyphase branch is either a plain delay or HALFBAND_TAPS taps.
+// The taps are a Kaiser windowed sinc, made once and shared.
+// T is float or a lane type like Float2.
+
+// taps in the non trivial branch, the whole filter has 2 * this - 1 taps
+// 24 gives about 60 dB of rejection with the band edge at 0.21 of the
+// oversampled rate (20kHz at 2x 48kHz)
+#define HALFBAND_TAPS 24
+
+class HalfbandTaps {
+public:
+  // the non zero taps of the even branch, symmetric
+  static const float *Get() {
+    static float taps[HALFBAND_TAPS];
+    static bool made = false;
+    if (!made) {
+      make(taps);
+      made = true;
+    }
+    return taps;
+  }
+
+private:
+  // modified Bessel function of the first kind, for the Kaiser window
+  static double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++) {
+      term *= (x / (2.0 * k)) * (x / (2.0 * k));
+      sum += term;
+    }
+    return sum;
+  }
+
+  static void make(float *taps) {
+    const int length = 2 * HALFBAND_TAPS - 1; // whole filter
+    const int center = HALFBAND_TAPS - 1;
+    const double beta = 6.0;
+    for (int j = 0; j < HALFBAND_TAPS; j++) {
+      // even taps of the whole filter are an odd distance from the center
+      int n = 2 * j - center;
+      double sinc = sin(M_PI * n / 2.0) / (M_PI * n);
+      double w = 2.0 * (2 * j) / (length - 1) - 1.0;
+      double window = besselI0(beta * sqrt(1.0 - w * w)) / besselI0(beta);
+      taps[j] = float(sinc * window);
+    }
+  }
+};
+
+// Doubles the sample rate
+template <typename T> class UpsamplerT {
+public:
+  void Init() {
+    taps_ = HalfbandTaps::Get();
+    for (int i = 0; i < 2 * HALFBAND_TAPS; i++) {
+      x_[i] = 0.0f;
+    }
+    pos_ = 0;
+  }
+
+  // One sample in, two out
+  void Process(T in, T &out0, T &out1) {
+    // history is stored twice so it can be read without wrapping
+    pos_ = pos_ == 0 ? HALFBAND_TAPS - 1 : pos_ - 1;
+    x_[pos_] = in;
+    x_[pos_ + HALFBAND_TAPS] = in;
+    const T *x = x_ + pos_;
+    // the taps are symmetric, add the pairs first to halve the multiplies
+    T sum = taps_[0] * (x[0] + x[HALFBAND_TAPS - 1]);
+    for (int j = 1; j < HALFBAND_TAPS / 2; j++) {
+      sum += taps_[j] * (x[j] + x[HALFBAND_TAPS - 1 - j]);
+    }
+    // gain of 2 makes up for the inserted zeros, the other branch is the
+    // center tap (0.5) so just a delayed sample
+    out0 = 2.0f * sum;
+    out1 = x[HALFBAND_TAPS / 2 - 1];
+  }
+
+private:
+  const float *taps_;
+  T x_[2 * HALFBAND_TAPS];
+  int pos_;
+};
+
+// Halves the sample rate
+template <typename T> class DownsamplerT {
+public:
+  void Init() {
+    taps_ = HalfbandTaps::Get();
+    for (int i = 0; i < 2 * HALFBAND_TAPS; i++) {
+      even_[i] = 0.0f;
+      odd_[i] = 0.0f;
+    }
+    pos_ = 0;
+  }
+
+  // Two samples in, one out
+  T Process(T in0, T in1) {
+    pos_ = pos_ == 0 ? HALFBAND_TAPS - 1 : pos_ - 1;
+    even_[pos_] = in0;
+    even_[pos_ + HALFBAND_TAPS] = in0;
+    odd_[pos_] = in1;
+    odd_[pos_ + HALFBAND_TAPS] = in1;
+    const T *x = even_ + pos_;
+    // the taps are symmetric, add the pairs first to halve the multiplies
+    T sum = taps_[0] * (x[0] + x[HALFBAND_TAPS - 1]);
+    for (int j = 1; j < HALFBAND_TAPS / 2; j++) {
+      sum += taps_[j] * (x[j] + x[HALFBAND_TAPS - 1 - j]);
+    }
+    // center tap on the odd branch
+    return sum + 0.5f * odd_[pos_ + HALFBAND_TAPS / 2];
+  }
+
+private:
+  const float *taps_;
+  T even_[2 * HALFBAND_TAPS];
+  T odd_[2 * HALFBAND_TAPS];
+  int pos_;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "FastMath.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Modulation worked out once per block
+//
+// The sources (LFOs, and each voice's envelopes as they are at the start of
+// the block) go through a fixed number of routes, each one adds source *
+// amount to a destination. That happens once per block and voice, so a
+// route costs the same whatever the block size and nothing per sample.
+// Per sample interpolation is up to the destination, only the filter
+// frequency and the pitch have it (the filter slides to its new frequency
+// across the block, the oscillator ramps its pitch offset)
+
+#define MOD_NUM_LFOS 2
+#define MOD_MAX_ROUTES 8
+
+enum ModSource {
+  MOD_SRC_LFO1 = 0, // -1 to 1
+  MOD_SRC_LFO2,
+  MOD_SRC_ENV1, // amplitude envelope, 0 to 1
+  MOD_SRC_ENV2, // filter envelope, 0 to the filter scale
+  MOD_NUM_SOURCES,
+};
+
+enum ModDest {
+  MOD_DST_FILTER_FREQ = 0, // index, added to the knob
+  MOD_DST_FILTER_Q,        // index, added to the knob
+  MOD_DST_DETUNE,          // added to the knob
+  MOD_DST_PAN_SPREAD,      // added to 1 (saws spread hard left and right)
+  MOD_DST_PITCH,           // notes
+  MOD_NUM_DESTS,
+};
+
+// A low frequency oscillator, read once per block
+class Lfo {
+public:
+  enum Shape {
+    SINE = 0,
+    TRIANGLE,
+    SAW, // rising
+    SQUARE,
+  };
+
+  void Init(float sr) {
+    sr_ = sr;
+    phase_ = 0.0f;
+    shape_ = SINE;
+    SetRate(1.0f);
+  }
+
+  // in Hz
+  void SetRate(float rate) {
+    rate_ = rate;
+    inc_ = rate / sr_;
+  }
+  float GetRate() { return rate_; }
+
+  void SetShape(Shape shape) { shape_ = shape; }
+  Shape GetShape() { return shape_; }
+
+  // Back to the start of the cycle
+  void Reset() { phase_ = 0.0f; }
+
+  // Value now (-1 to 1), then move on by size samples
+  float Process(size_t size) {
+    float value = get(phase_);
+    phase_ += inc_ * size;
+    phase_ -= fastFloor(phase_);
+    return value;
+  }
+
+private:
+  float sr_, rate_, inc_;
+  float phase_; // 0 to 1
+  Shape shape_;
+
+  float get(float phase) {
+    switch (shape_) {
+    case TRIANGLE:
+      return phase < 0.5f ? 4.0f * phase - 1.0f : 3.0f - 4.0f * phase;
+    case SAW:
+      return 2.0f * phase - 1.0f;
+    case SQUARE:
+      return phase < 0.5f ? 1.0f : -1.0f;
+    default:
+      // a block is a few ms, the low tier is plenty
+      return FastSin<FAST_LOW>(6.2831853f * phase);
+    }
+  }
+};
+
+// Routes from the sources to the destinations
+class ModMatrix {
+public:
+  struct Route {
+    ModSource source;
+    ModDest dest;
+    float amount; // 0 is off
+  };
+
+  ModMatrix() { Clear(); }
+
+  void Clear() {
+    for (int i = 0; i < MOD_MAX_ROUTES; i++) {
+      routes_[i].source = MOD_SRC_LFO1;
+      routes_[i].dest = MOD_DST_FILTER_FREQ;
+      routes_[i].amount = 0.0f;
+    }
+    numActive_ = 0;
+    destMask_ = 0;
+  }
+
+  /**
+   * Set one of the MOD_MAX_ROUTES slots
+   *
+   * @param amount How much of the source goes to the destination, 0 turns
+   * the slot off
+   */
+  void SetRoute(int slot, ModSource source, ModDest dest, float amount) {
+    routes_[slot].source = source;
+    routes_[slot].dest = dest;
+    routes_[slot].amount = amount;
+    // the slots that are on, so the ones that are off cost nothing
+    numActive_ = 0;
+    destMask_ = 0;
+    for (int i = 0; i < MOD_MAX_ROUTES; i++) {
+      if (routes_[i].amount != 0.0f) {
+        active_[numActive_++] = i;
+        destMask_ |= 1u << routes_[i].dest;
+      }
+    }
+  }
+  const Route &GetRoute(int slot) const { return routes_[slot]; }
+
+  // Bit d is set when something goes to destination d
+  uint32_t GetDestMask() const { return destMask_; }
+  bool IsModulated(ModDest dest) const { return destMask_ & (1u << dest); }
+
+  /**
+   * Sum the routes into the destinations
+   *
+   * @param sources MOD_NUM_SOURCES values
+   * @param dests MOD_NUM_DESTS values, the ones nothing goes to come out 0
+   */
+  void Process(const float *sources, float *dests) const {
+    for (int d = 0; d < MOD_NUM_DESTS; d++) {
+      dests[d] = 0.0f;
+    }
+    for (int a = 0; a < numActive_; a++) {
+      const Route &r = routes_[active_[a]];
+      dests[r.dest] += sources[r.source] * r.amount;
+    }
+  }
+
+private:
+  Route routes_[MOD_MAX_ROUTES];
+  int active_[MOD_MAX_ROUTES];
+  int numActive_;
+  uint32_t destMask_;
+};
@@ -1,108 +1,477 @@
 #pragma once
 
+#include "FastMath.hpp"
+#include "SawTables.hpp"
+#include "Simd.hpp"
 #include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
 
-class Oscillator {
+// saws per oscillator, eg 3 for big polyphonic patches or 16 for mono leads
+#ifndef SWARM_SAWS
+#define SWARM_SAWS 7
+#endif
+
+// Detune (cents at full detune) and pan for each saw, spread out from the
+// middle. The outer pairs are detuned more, for 7 saws that's 0, 3, 7 and
+// 12 cents
+template <int N> struct SawSpread {
+  float cents[N];
+  float pans[N];
+};
+
+template <int N> constexpr SawSpread<N> MakeSawSpread() {
+  SawSpread<N> spread = {};
+  // odd counts have a saw in the middle, the others come in pairs around
+  // it, the outer pair is at edge
+  float edge = (N - 1) * 0.5f;
+  for (int i = 0; i < N; i++) {
+    float pos = N % 2 == 1 ? float((i + 1) / 2) : float(i / 2) + 0.5f;
+    float sign = i % 2 == N % 2 ? -1.0f : 1.0f;
+    if (edge > 0.0f) {
+      spread.cents[i] =
+          sign * 12.0f * (pos * pos + 5.0f * pos) / (edge * edge + 5.0f * edge);
+      spread.pans[i] = sign * pos / edge;
+    }
+  }
+  return spread;
+}
+
+// N is the number of saws, see the Oscillator typedef below
+template <int N> class OscillatorT {
 public:
-  Oscillator() {}
-  ~Oscillator() {}
+  OscillatorT() {}
+  ~OscillatorT() {}
+
+  // How the saws are made
+  enum Mode {
+    POLYBLEP = 0, // naive saw with polyBLEP corrections at the jumps
+    WAVETABLE,    // bandlimited table for the octave, see SawTables.hpp
+  };
 
   void Init(float sr) {
     sr_ = sr;
+    mode_ = POLYBLEP;
     amp_ = 0.5f;
     detune_ = 0.0f;
-    std::fill(freqs_, freqs_ + 7, 440.0f);
-    std::fill(phases_, phases_ + 7, 0.0f);
-    calcDetuneRatio();
-    calcPhaseIncs();
+    pitch_ = 69.0f;
+    glideTarget_ = pitch_;
+    glideStep_ = 0.0f;
+    glideRemaining_ = 0;
+    pitchMod_ = 0.0f;
+    modTarget_ = 0.0f;
+    modStep_ = 0.0f;
+    modRemaining_ = 0;
+    incRatio_ = 1.0f;
+    // no table until WAVETABLE is picked
+    table_ = nullptr;
+    tableSize_ = 0;
+    std::fill(phases_, phases_ + numLanes_, 0.0f);
+    // the padding lanes stay silent
+    std::fill(gains1_, gains1_ + numLanes_, 0.0f);
+    std::fill(gains2_, gains2_ + numLanes_, 0.0f);
+    panSpread_ = 1.0f;
+    calcGains();
+    CalcDetuneRatios(detune_, detuneRatio_);
+    calcFreqs();
   }
 
-  void SetNote(int n) {
-    baseFreq_ = 440.0f * powf(2.0f, (n - 69.0f) / 12.0f);
-    for (int i = 0; i < 7; i++) {
-      freqs_[i] = baseFreq_ * detuneRatio_[i];
+  // Jump to a pitch, a MIDI note number that can be between notes. The
+  // increments are only worked out again when it changes
+  void SetPitch(float note) {
+    glideRemaining_ = 0;
+    if (note != pitch_) {
+      pitch_ = note;
+      calcFreqs();
+    }
+  }
+
+  void SetNote(int n) { SetPitch(static_cast<float>(n)); }
+
+  /**
+   * Slide to a pitch in a straight line (in notes, so exponential in Hz),
+   * a little further every sample
+   *
+   * @param note Where to end up, a MIDI note number
+   * @param time Seconds to get there, 0 jumps
+   */
+  void GlideTo(float note, float time) {
+    uint32_t samples = static_cast<uint32_t>(time * sr_);
+    if (samples == 0 || note == pitch_) {
+      SetPitch(note);
+      return;
+    }
+    glideTarget_ = note;
+    glideRemaining_ = samples;
+    glideStep_ = (note - pitch_) / samples;
+  }
+
+  // where the pitch is now, in the middle of a glide too, without the
+  // offset from SetPitchMod
+  float GetPitch() { return pitch_; }
+
+  /**
+   * Offset on top of the pitch, eg from an LFO, ramped to in a straight
+   * line like a glide so a new value every block doesn't step
+   *
+   * @param notes The offset, in notes
+   * @param rampSamples Samples to get there, 0 jumps
+   */
+  void SetPitchMod(float notes, uint32_t rampSamples) {
+    if (notes == modTarget_) {
+      return;
+    }
+    modTarget_ = notes;
+    if (rampSamples == 0) {
+      pitchMod_ = notes;
+      modRemaining_ = 0;
+      calcFreqs();
+      return;
+    }
+    modRemaining_ = rampSamples;
+    modStep_ = (notes - pitchMod_) / rampSamples;
+  }
+  float GetPitchMod() { return pitchMod_; }
+
+  /**
+   * How far the saws are panned out, 1 is hard left and right for the
+   * outer pair, 0 all in the middle, up to 2 pushes the inner ones out too
+   */
+  void SetPanSpread(float spread) {
+    spread = spread < 0.0f ? 0.0f : (spread > 2.0f ? 2.0f : spread);
+    if (spread != panSpread_) {
+      panSpread_ = spread;
+      calcGains();
     }
-    calcPhaseIncs();
   }
+  float GetPanSpread() { return panSpread_; }
 
   void SetAmp(float a) { amp_ = a; }
 
   void SetDetune(float d) {
+    detune_ = ClampDetune(d);
+    CalcDetuneRatios(detune_, detuneRatio_);
+    calcFreqs();
+  }
+
+  // Same as SetDetune with the ratios from CalcDetuneRatios
+  void SetDetuneRatios(float d, const float *ratios) {
+    detune_ = d;
+    std::copy(ratios, ratios + numSaws_, detuneRatio_);
+    calcFreqs();
+  }
+
+  static float ClampDetune(float d) {
     // with detune at 0 the phase of the saws make everything sound weird
-    detune_ = (d < 0.1f) ? 0.01f : (d > 1.0f ? 1.0f : d);
-    calcDetuneRatio();
+    return (d < 0.1f) ? 0.01f : (d > 1.0f ? 1.0f : d);
+  }
+
+  // Frequency ratio of each saw for a (clamped) detune, cheap enough to
+  // run every block while the detune glides
+  static void CalcDetuneRatios(float d, float *ratios) {
+    for (int i = 0; i < numSaws_; i++) {
+      // 2^x as e^y with a few terms of the series, the saws are at most
+      // 12 cents out so y stays under 0.007 and the error under 1e-10
+      float y = spread_.cents[i] * d * (0.69314718f / 1200.0f);
+      ratios[i] = 1.0f + y * (1.0f + y * 0.5f * (1.0f + y * (1.0f / 3.0f)));
+    }
   }
 
   float GetDetune() { return detune_; }
 
+  // The saw tables are made the first time any oscillator is switched to
+  // WAVETABLE, so not from the audio callback
+  void SetMode(Mode mode) {
+    mode_ = mode;
+    if (mode_ == WAVETABLE) {
+      selectTable(maxInc_);
+    }
+  }
+  Mode GetMode() { return mode_; }
+
+  // frequency of one saw, eg for analysis
+  float GetFreq(int saw) { return freqs_[saw]; }
+  int GetNumSaws() { return numSaws_; }
+
   void Process(float *out1, float *out2) {
+    ProcessBlock(out1, out2, &amp_, 1);
+  }
 
-    *out1 = 0.0f;
-    *out2 = 0.0f;
+  /**
+   * Fill two buffers with the next size samples
+   *
+   * @param out1 Left output
+   * @param out2 Right output
+   * @param amp Amplitude for each sample, eg from an envelope
+   * @param size Number of samples
+   */
+  void ProcessBlock(float *out1, float *out2, const float *amp, size_t size) {
+    // while gliding or ramping the offset the increments move every sample,
+    // back to the exact pitch at the end of every stretch so the rounding
+    // doesn't add up
+    while ((glideRemaining_ > 0 || modRemaining_ > 0) && size > 0) {
+      size_t n = size;
+      float step = 0.0f; // notes per sample, both ramps together
+      if (glideRemaining_ > 0) {
+        n = n < glideRemaining_ ? n : glideRemaining_;
+        step += glideStep_;
+      }
+      if (modRemaining_ > 0) {
+        n = n < modRemaining_ ? n : modRemaining_;
+        step += modStep_;
+      }
+      // in Hz that's the same ratio every sample
+      incRatio_ = FastExp2(step * (1.0f / 12.0f));
+      if (mode_ == WAVETABLE && step > 0.0f) {
+        // the level for the highest the saws get in this stretch
+        selectTable(maxInc_ * FastExp2(step * n * (1.0f / 12.0f)));
+      }
+      process<true>(out1, out2, amp, n);
+      if (glideRemaining_ > 0) {
+        glideRemaining_ -= n;
+        pitch_ = glideRemaining_ > 0 ? pitch_ + glideStep_ * n : glideTarget_;
+      }
+      if (modRemaining_ > 0) {
+        modRemaining_ -= n;
+        pitchMod_ = modRemaining_ > 0 ? pitchMod_ + modStep_ * n : modTarget_;
+      }
+      calcFreqs();
+      out1 += n;
+      out2 += n;
+      amp += n;
+      size -= n;
+    }
+    if (size > 0) {
+      process<false>(out1, out2, amp, size);
+    }
+  }
+
+private:
+  Mode mode_;
+
+  // a few saws fit in one Float4, more get padded to blocks of Float8
+  static constexpr int numSaws_ = N;
+  typedef typename std::conditional<(N <= 4), Float4, Float8>::type Lanes;
+  static constexpr int laneWidth_ = N <= 4 ? 4 : 8;
+  static constexpr int numBlocks_ = (N + laneWidth_ - 1) / laneWidth_;
+  static constexpr int numLanes_ = numBlocks_ * laneWidth_;
+
+  static constexpr SawSpread<N> spread_ = MakeSawSpread<N>();
+
+  float sr_, amp_;
+  float freqs_[numSaws_];
+  float detune_;
+  float detuneRatio_[numSaws_];
+
+  // pitch as a MIDI note, and the glide to glideTarget_
+  float pitch_, glideTarget_, glideStep_;
+  uint32_t glideRemaining_; // samples
+  // offset on top of the pitch, ramping to modTarget_
+  float pitchMod_, modTarget_, modStep_;
+  uint32_t modRemaining_; // samples
+  // how much the increments grow every sample while either ramps
+  float incRatio_;
+  float panSpread_;
+
+  // per lane state for the kernel
+  alignas(32) float phases_[numLanes_];
+  alignas(32) float phaseIncs_[numLanes_];
+  alignas(32) float invPhaseIncs_[numLanes_];
+  alignas(32) float gains1_[numLanes_]; // left, pan and normalization
+  alignas(32) float gains2_[numLanes_]; // right, pan and normalization
+
+  // table level for the current frequencies, only kept up to date in
+  // WAVETABLE
+  const float *table_;
+  int tableSize_;
+  float maxInc_; // of the highest saw, picks the level
 
-    for (int i = 0; i < 7; i++) {
-      saws_[i] = (2.0f * phases_[i]) - 1.0f;
-      saws_[i] -= polyBLEP(phases_[i], phaseIncs_[i]);
+  template <bool Glide>
+  void process(float *out1, float *out2, const float *amp, size_t size) {
+    if (mode_ == WAVETABLE) {
+      processTable<Glide>(out1, out2, amp, size);
+    } else {
+      processBlep<Glide>(out1, out2, amp, size);
     }
+  }
+
+#if defined(SIMD_NONE)
+  // one saw at a time with branches, without SIMD the lanes below would
+  // work out both corrections for every saw and the padding, most samples
+  // need neither
+  template <bool Glide>
+  void processBlep(float *out1, float *out2, const float *amp, size_t size) {
+    float phases[numSaws_], incs[numSaws_], invIncs[numSaws_];
+    std::copy(phases_, phases_ + numSaws_, phases);
+    std::copy(phaseIncs_, phaseIncs_ + numSaws_, incs);
+    std::copy(invPhaseIncs_, invPhaseIncs_ + numSaws_, invIncs);
+    const float invRatio = 1.0f / incRatio_;
 
-    for (int i = 0; i < 7; i++) {
-      *out1 += saws_[i] * (1.0f - pans_[i]) * 0.5f * norm_;
-      *out2 += saws_[i] * (1.0f + pans_[i]) * 0.5f * norm_;
+    for (size_t n = 0; n < size; n++) {
+      float sum1 = 0.0f, sum2 = 0.0f;
+      for (int j = 0; j < numSaws_; j++) {
+        float phase = phases[j];
+        float saw = 2.0f * phase - 1.0f;
+        if (phase < incs[j]) {
+          // beginning of wave
+          float t = phase * invIncs[j];
+          saw -= t + t - t * t - 1.0f;
+        } else if (phase > 1.0f - incs[j]) {
+          // end of wave
+          float t = (phase - 1.0f) * invIncs[j];
+          saw -= t * t + t + t + 1.0f;
+        }
+        sum1 += saw * gains1_[j];
+        sum2 += saw * gains2_[j];
+        phase += incs[j];
+        if (phase > 1.0f) {
+          phase -= 1.0f;
+        }
+        phases[j] = phase;
+        if (Glide) {
+          incs[j] *= incRatio_;
+          invIncs[j] *= invRatio;
+        }
+      }
+      out1[n] = sum1 * amp[n];
+      out2[n] = sum2 * amp[n];
     }
 
-    for (int i = 0; i < 7; i++) {
-      phases_[i] += phaseIncs_[i];
-      if (phases_[i] > 1.0f) {
-        phases_[i] -= 1.0f;
+    std::copy(phases, phases + numSaws_, phases_);
+  }
+#else
+  // all the saws are processed together, one per lane, numBlocks_ is a
+  // constant so the block loops unroll
+  template <bool Glide>
+  void processBlep(float *out1, float *out2, const float *amp, size_t size) {
+    Lanes phases[numBlocks_], incs[numBlocks_], invIncs[numBlocks_];
+    Lanes gains1[numBlocks_], gains2[numBlocks_];
+    for (int b = 0; b < numBlocks_; b++) {
+      phases[b] = Lanes::Load(phases_ + b * laneWidth_);
+      incs[b] = Lanes::Load(phaseIncs_ + b * laneWidth_);
+      invIncs[b] = Lanes::Load(invPhaseIncs_ + b * laneWidth_);
+      gains1[b] = Lanes::Load(gains1_ + b * laneWidth_);
+      gains2[b] = Lanes::Load(gains2_ + b * laneWidth_);
+    }
+    const Lanes one(1.0f);
+    const Lanes two(2.0f);
+    const Lanes zero(0.0f);
+    const Lanes ratio(incRatio_);
+    const Lanes invRatio(1.0f / incRatio_);
+
+    for (size_t n = 0; n < size; n++) {
+      Lanes sum1(0.0f), sum2(0.0f);
+      for (int b = 0; b < numBlocks_; b++) {
+        Lanes saw = two * phases[b] - one;
+
+        // polyBLEP without branches, both corrections are computed and
+        // masked, they never overlap because the increment is below 0.5
+        // beginning of wave: t + t - t * t - 1 with t = phase / inc
+        Lanes t = phases[b] * invIncs[b];
+        Lanes blep =
+            Select(CmpLt(phases[b], incs[b]), two * t - t * t - one, zero);
+        // end of wave: t * t + t + t + 1 with t = (phase - 1) / inc
+        t = (phases[b] - one) * invIncs[b];
+        blep = Select(CmpGt(phases[b], one - incs[b]), t * t + two * t + one,
+                      blep);
+        saw = saw - blep;
+
+        sum1 += saw * gains1[b];
+        sum2 += saw * gains2[b];
+
+        phases[b] = phases[b] + incs[b];
+        phases[b] = phases[b] - Select(CmpGt(phases[b], one), one, zero);
+        if (Glide) {
+          incs[b] = incs[b] * ratio;
+          invIncs[b] = invIncs[b] * invRatio;
+        }
       }
+      out1[n] = sum1.Sum() * amp[n];
+      out2[n] = sum2.Sum() * amp[n];
     }
 
-    *out1 = *out1 * amp_;
-    *out2 = *out2 * amp_;
+    for (int b = 0; b < numBlocks_; b++) {
+      phases[b].Store(phases_ + b * laneWidth_);
+    }
   }
+#endif
 
-private:
-  float sr_, amp_, baseFreq_;
-  float norm_ = 1 / sqrt(7);
-  float freqs_[7], phases_[7], phaseIncs_[7];
-  float detune_;
-  float detuneCents_[7] = {0, -3, 3, -7, 7, -12, 12};
-  float detuneRatio_[7];
-  float pans_[7] = {0, -0.33f, 0.33f, -0.66f, 0.66f, -1.0f, 1.0f};
+  // Same as processBlep but reading the saws from the table, no gather on
+  // the Cortex-M7 so the lanes are a plain loop
+  template <bool Glide>
+  void processTable(float *out1, float *out2, const float *amp,
+                    size_t size) {
+    const float *table = table_;
+    const float tableSize = static_cast<float>(tableSize_);
+    float phases[numSaws_], incs[numSaws_];
+    std::copy(phases_, phases_ + numSaws_, phases);
+    std::copy(phaseIncs_, phaseIncs_ + numSaws_, incs);
 
-  void calcPhaseIncs() {
-    for (int i = 0; i < 7; i++) {
-      phaseIncs_[i] = freqs_[i] * (1.0f / sr_);
+    for (size_t n = 0; n < size; n++) {
+      float sum1 = 0.0f, sum2 = 0.0f;
+      for (int j = 0; j < numSaws_; j++) {
+        // phase can be exactly 1, the table has 2 wrap points for that
+        float x = phases[j] * tableSize;
+        int i = static_cast<int>(x);
+        float saw = table[i] + (x - i) * (table[i + 1] - table[i]);
+        sum1 += saw * gains1_[j];
+        sum2 += saw * gains2_[j];
+        phases[j] += incs[j];
+        phases[j] -= phases[j] > 1.0f ? 1.0f : 0.0f;
+        if (Glide) {
+          incs[j] *= incRatio_;
+        }
+      }
+      out1[n] = sum1 * amp[n];
+      out2[n] = sum2 * amp[n];
     }
+
+    std::copy(phases, phases + numSaws_, phases_);
   }
 
-  void calcDetuneRatio() {
-    for (int i = 0; i < 7; i++) {
-      detuneRatio_[i] = powf(2.0f, (detuneCents_[i] * detune_) / 1200.0f);
+  void calcFreqs() {
+    float baseFreq =
+        440.0f * FastExp2((pitch_ + pitchMod_ - 69.0f) * (1.0f / 12.0f));
+    for (int i = 0; i < numSaws_; i++) {
+      freqs_[i] = baseFreq * detuneRatio_[i];
     }
+    calcPhaseIncs();
   }
 
-  float saws_[7];
+  // pan and normalization for each saw
+  void calcGains() {
+    const float norm = 1.0f / sqrtf(numSaws_);
+    for (int i = 0; i < numSaws_; i++) {
+      float pan = spread_.pans[i] * panSpread_;
+      pan = pan < -1.0f ? -1.0f : (pan > 1.0f ? 1.0f : pan);
+      gains1_[i] = (1.0f - pan) * 0.5f * norm;
+      gains2_[i] = (1.0f + pan) * 0.5f * norm;
+    }
+  }
 
-  float t, dt;
-  float polyBLEP(float phase, float phaseInc) {
-    // t is usually divided by 2pi because
-    // it usually goes from 0 to 2pi, but here it
-    // goes from 0 to 1, I guess?
-    // It doesn't work if I use 2pi
-    t = phase;
-    dt = phaseInc;
-    // beginning of wave
-    if (t < dt) {
-      t /= dt;
-      return t + t - t * t - 1.0f; // adds some sort of smoothing?
-    } // don't really understand
-    // end of wave
-    else if (t > 1.0f - dt) {
-      t = (t - 1.0f) / dt;
-      return t * t + t + t + 1.0f;
-    } else {
-      return 0.0f;
+  void calcPhaseIncs() {
+    // the padding lanes don't move
+    std::fill(phaseIncs_, phaseIncs_ + numLanes_, 0.0f);
+    std::fill(invPhaseIncs_, invPhaseIncs_ + numLanes_, 0.0f);
+    for (int i = 0; i < numSaws_; i++) {
+      phaseIncs_[i] = freqs_[i] * (1.0f / sr_);
+      invPhaseIncs_[i] = 1.0f / phaseIncs_[i];
+    }
+    // the highest saw picks the level, so none of them alias
+    maxInc_ = *std::max_element(phaseIncs_, phaseIncs_ + numSaws_);
+    if (mode_ == WAVETABLE) {
+      selectTable(maxInc_);
     }
   }
-};
\ No newline at end of file
+
+  void selectTable(float maxInc) {
+    const SawTables::Level &level = SawTables::Select(maxInc, sr_);
+    table_ = level.data;
+    tableSize_ = level.size;
+  }
+};
+
+template <int N> constexpr SawSpread<N> OscillatorT<N>::spread_;
+
+typedef OscillatorT<SWARM_SAWS> Oscillator;
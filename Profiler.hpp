@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#if !defined(__arm__)
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+#endif
+
+// Per stage timing of the audio callback
+//
+// PROFILE_SCOPE(stage) times the rest of the enclosing block and adds it to
+// the stage, PROFILE_END_BLOCK() at the end of the callback folds what each
+// stage took in that block into its min/avg/max and histogram.
+// Both compile to nothing unless SWARM_PROFILE is defined, so the scopes
+// can stay in the DSP code.
+// Ticks are CPU cycles from the DWT counter on the Daisy, TSC ticks on x86
+// and nanoseconds elsewhere.
+
+// stages of the callback, a scope can be opened for one many times a block
+enum ProfileStage {
+  PROFILE_MIDI = 0, // handing the MIDI from the main loop to the synth
+  PROFILE_PARAMS,   // parameter updates and smoothing
+  PROFILE_ENV,      // both envelopes of every voice
+  PROFILE_OSC,      // the saws of every voice
+  PROFILE_FILTER,   // the filter of every voice, with the coefficient lookup
+  PROFILE_NUM_STAGES,
+};
+
+// histogram bins, bin i counts blocks that took 2^(i + shift) ticks or more,
+// the first one also gets anything shorter
+#define PROFILE_HISTOGRAM_BINS 16
+#define PROFILE_HISTOGRAM_SHIFT 6
+
+class Profiler {
+public:
+  struct Stats {
+    uint32_t min, max;
+    uint64_t total; // for the average
+    uint32_t blocks;
+    uint32_t histogram[PROFILE_HISTOGRAM_BINS];
+
+    // ticks per block
+    float GetAvg() const { return blocks > 0 ? float(total) / blocks : 0.0f; }
+  };
+
+  // The profiler everything adds to
+  static Profiler &Get() {
+    static Profiler profiler;
+    return profiler;
+  }
+
+  Profiler() { reset(); }
+
+  // Starts the cycle counter, call once at boot
+  static void Init() {
+#if defined(__arm__)
+    // TRCENA in DEMCR, unlock the DWT and start CYCCNT
+    *reinterpret_cast<volatile uint32_t *>(0xE000EDFC) |= 1u << 24;
+    *reinterpret_cast<volatile uint32_t *>(0xE0001FB0) = 0xC5ACCE55;
+    *reinterpret_cast<volatile uint32_t *>(0xE0001004) = 0;
+    *reinterpret_cast<volatile uint32_t *>(0xE0001000) |= 1;
+#endif
+  }
+
+  static uint32_t Now() {
+#if defined(__arm__)
+    return *reinterpret_cast<volatile uint32_t *>(0xE0001004);
+#elif defined(__x86_64__) || defined(__i386__)
+    return static_cast<uint32_t>(__rdtsc());
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint32_t>(ts.tv_sec * 1000000000ull + ts.tv_nsec);
+#endif
+  }
+
+  // audio side
+  void Add(int stage, uint32_t ticks) { blockTicks_[stage] += ticks; }
+
+  // audio side, at the end of every callback
+  void EndBlock() {
+    if (resetRequested_) {
+      reset();
+      return;
+    }
+    for (int s = 0; s < PROFILE_NUM_STAGES; s++) {
+      uint32_t ticks = blockTicks_[s];
+      blockTicks_[s] = 0;
+      Stats &st = stats_[s];
+      st.min = ticks < st.min ? ticks : st.min;
+      st.max = ticks > st.max ? ticks : st.max;
+      st.total += ticks;
+      st.blocks++;
+      st.histogram[bin(ticks)]++;
+    }
+  }
+
+  // Main loop side, start over from the next block
+  void Reset() { resetRequested_ = true; }
+
+  // Main loop side, can be a block out of date while the callback runs
+  const Stats &GetStats(int stage) { return stats_[stage]; }
+
+  static const char *GetStageName(int stage) {
+    static const char *names[PROFILE_NUM_STAGES] = {"Midi", "Prms", "Env",
+                                                    "Osc", "Filt"};
+    return names[stage];
+  }
+
+private:
+  Stats stats_[PROFILE_NUM_STAGES];
+  uint32_t blockTicks_[PROFILE_NUM_STAGES];
+  volatile bool resetRequested_;
+
+  void reset() {
+    for (int s = 0; s < PROFILE_NUM_STAGES; s++) {
+      Stats &st = stats_[s];
+      st.min = UINT32_MAX;
+      st.max = 0;
+      st.total = 0;
+      st.blocks = 0;
+      for (int b = 0; b < PROFILE_HISTOGRAM_BINS; b++) {
+        st.histogram[b] = 0;
+      }
+      blockTicks_[s] = 0;
+    }
+    resetRequested_ = false;
+  }
+
+  static int bin(uint32_t ticks) {
+    // floor(log2(ticks)) from the leading zeros
+    int b = ticks == 0 ? 0 : 31 - __builtin_clz(ticks);
+    b -= PROFILE_HISTOGRAM_SHIFT;
+    return b < 0 ? 0 : (b >= PROFILE_HISTOGRAM_BINS ? PROFILE_HISTOGRAM_BINS - 1
+                                                    : b);
+  }
+};
+
+// Times the rest of the enclosing block for a stage
+class ProfileScope {
+public:
+  explicit ProfileScope(int stage) : stage_(stage), start_(Profiler::Now()) {}
+  ~ProfileScope() { Profiler::Get().Add(stage_, Profiler::Now() - start_); }
+
+private:
+  int stage_;
+  uint32_t start_;
+};
+
+#ifdef SWARM_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(stage)                                                   \
+  ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(stage)
+#define PROFILE_END_BLOCK() Profiler::Get().EndBlock()
+#else
+#define PROFILE_SCOPE(stage)
+#define PROFILE_END_BLOCK()
+#endif
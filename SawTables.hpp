@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cmath>
+
+// Mip-mapped bandlimited saw tables
+//
+// Level 0 has SAW_TABLE_MAX_HARMONICS harmonics and every level after it
+// half as many, down to a sine. A level has SAW_TABLE_OVERSAMPLE points
+// per harmonic (and at least SAW_TABLE_MIN_SIZE) so a linear interpolating
+// read stays clean.
+// Made the first time Get is called and shared, they don't depend on the
+// sample rate.
+
+#define SAW_TABLE_LEVELS 10
+#define SAW_TABLE_MAX_HARMONICS 512
+#define SAW_TABLE_OVERSAMPLE 8
+#define SAW_TABLE_MIN_SIZE 512
+
+class SawTables {
+public:
+  struct Level {
+    const float *data; // size + 2 points, the last two wrap around
+    int size;
+    int harmonics;
+  };
+
+  static const Level *Get();
+
+  /**
+   * The level with the most harmonics that doesn't alias below 20kHz
+   *
+   * @param inc Phase increment of the highest saw
+   * @param sr Sample rate
+   */
+  static const Level &Select(float inc, float sr) {
+    const Level *levels = Get();
+    // a harmonic up to sr - 20kHz folds back above 20kHz
+    float limit = sr - 20000.0f;
+    limit = limit < 0.5f * sr ? 0.5f * sr : limit;
+    float harmonics = limit / (inc * sr);
+    int i = 0;
+    while (i < SAW_TABLE_LEVELS - 1 && levels[i].harmonics > harmonics) {
+      i++;
+    }
+    return levels[i];
+  }
+
+private:
+  static constexpr int levelSize(int level) {
+    return (SAW_TABLE_MAX_HARMONICS >> level) * SAW_TABLE_OVERSAMPLE <
+                   SAW_TABLE_MIN_SIZE
+               ? SAW_TABLE_MIN_SIZE
+               : (SAW_TABLE_MAX_HARMONICS >> level) * SAW_TABLE_OVERSAMPLE;
+  }
+
+  static constexpr int totalSize(int level = 0) {
+    return level == SAW_TABLE_LEVELS
+               ? 0
+               : levelSize(level) + 2 + totalSize(level + 1);
+  }
+
+  static void make(float *data, Level *levels) {
+    for (int l = 0; l < SAW_TABLE_LEVELS; l++) {
+      int size = levelSize(l);
+      int harmonics = SAW_TABLE_MAX_HARMONICS >> l;
+      for (int i = 0; i < size; i++) {
+        // 2 * phase - 1 = -2/pi * sum(sin(2 pi k phase) / k)
+        // sin(k w) by recursion, far cheaper than calling sin every time
+        double w = 2.0 * M_PI * i / size;
+        double c = 2.0 * cos(w);
+        double s1 = 0.0, s0 = sin(w);
+        double sum = 0.0;
+        for (int k = 1; k <= harmonics; k++) {
+          sum += s0 / k;
+          double s = c * s0 - s1;
+          s1 = s0;
+          s0 = s;
+        }
+        data[i] = float(-2.0 / M_PI * sum);
+      }
+      data[size] = data[0];
+      data[size + 1] = data[1];
+      levels[l].data = data;
+      levels[l].size = size;
+      levels[l].harmonics = harmonics;
+      data += size + 2;
+    }
+  }
+};
+
+inline const SawTables::Level *SawTables::Get() {
+  static float data[totalSize()];
+  static Level levels[SAW_TABLE_LEVELS];
+  static bool made = false;
+  if (!made) {
+    make(data, levels);
+    made = true;
+  }
+  return levels;
+}
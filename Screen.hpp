@@ -0,0 +1,87 @@
+#pragma once
+
+#include "FixedText.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Text cells on the display that are only redrawn when they change
+//
+// Each cell is a position and the text drawn there. Setting the same text
+// again does nothing, Draw erases and redraws only the cells that changed
+// and says whether anything did, so the display only needs sending then.
+// One Screen per page, Invalidate after something else drew over it
+
+#define SCREEN_MAX_CELLS 24
+#define SCREEN_CELL_CHARS 12
+// Font_6x8
+#define SCREEN_CHAR_WIDTH 6
+#define SCREEN_CHAR_HEIGHT 8
+
+class Screen {
+public:
+  typedef FixedText<SCREEN_CELL_CHARS> Text;
+
+  Screen() : numCells_(0) {}
+
+  // Add a cell at (x, y), returns its number
+  int AddCell(uint8_t x, uint8_t y) {
+    Cell &cell = cells_[numCells_];
+    cell.x = x;
+    cell.y = y;
+    cell.dirty = true;
+    return numCells_++;
+  }
+
+  void SetText(int cell, const char *text) {
+    Cell &c = cells_[cell];
+    if (c.text != text) {
+      c.text.Set(text);
+      c.dirty = true;
+    }
+  }
+
+  // Everything is redrawn at the next Draw, eg after the display was cleared
+  void Invalidate() {
+    for (int i = 0; i < numCells_; i++) {
+      cells_[i].drawnSize = 0;
+      cells_[i].dirty = true;
+    }
+  }
+
+  /**
+   * Redraw the cells that changed
+   *
+   * @param display Something with PrintToScreen and ClearRect, eg FieldWrap
+   * @return true when something was drawn and the display needs updating
+   */
+  template <typename Display> bool Draw(Display &display) {
+    bool drawn = false;
+    for (int i = 0; i < numCells_; i++) {
+      Cell &c = cells_[i];
+      if (!c.dirty) {
+        continue;
+      }
+      // erase what was there, the new text can be shorter
+      if (c.drawnSize > 0) {
+        display.ClearRect(c.x, c.y, c.x + c.drawnSize * SCREEN_CHAR_WIDTH - 1,
+                          c.y + SCREEN_CHAR_HEIGHT - 1);
+      }
+      display.PrintToScreen(c.text.Get(), c.x, c.y);
+      c.drawnSize = c.text.Size();
+      c.dirty = false;
+      drawn = true;
+    }
+    return drawn;
+  }
+
+private:
+  struct Cell {
+    uint8_t x, y;
+    Text text;
+    size_t drawnSize; // characters on the display now
+    bool dirty;
+    Cell() : x(0), y(0), drawnSize(0), dirty(false) {}
+  };
+  Cell cells_[SCREEN_MAX_CELLS];
+  int numCells_;
+};
@@ -0,0 +1,272 @@
+#pragma once
+
+// Small portable lane types for the DSP kernels
+//
+// Float2 and Float4 use NEON or SSE when the compiler has them, Float8
+// uses AVX or two Float4. Without any of them (eg the Cortex-M7 on the
+// Daisy, which has no NEON or Helium) they fall back to plain float arrays
+// and SIMD_NONE is defined. Every lane op is then a loop of its own, so a
+// kernel that works out both sides of a Select costs far more than plain
+// code with branches, see the SIMD_NONE version of
+// OscillatorT::processBlep. Define SIMD_SCALAR to force the fallback.
+//
+// Masks are lane types too, made by the Cmp functions and used by Select
+
+#if !defined(SIMD_SCALAR) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMD_NEON
+#elif !defined(SIMD_SCALAR) && defined(__SSE2__)
+#include <immintrin.h>
+#define SIMD_SSE
+#if defined(__AVX__)
+#define SIMD_AVX
+#endif
+#else
+#define SIMD_NONE
+#endif
+
+inline float Min(float a, float b) { return a < b ? a : b; }
+inline float Max(float a, float b) { return a > b ? a : b; }
+
+// 2 float lanes, for stereo pairs
+struct Float2 {
+#if defined(SIMD_NEON)
+  float32x2_t v;
+  Float2() {}
+  Float2(float32x2_t x) : v(x) {}
+  Float2(float x) : v(vdup_n_f32(x)) {}
+  Float2(float a, float b) : v(vset_lane_f32(b, vdup_n_f32(a), 1)) {}
+  void Store(float *p) const { vst1_f32(p, v); }
+#elif defined(SIMD_SSE)
+  // the upper two lanes mirror the lower ones, they are never read but
+  // zeros there would end up as slow denormals in recursive filters
+  __m128 v;
+  Float2() {}
+  Float2(__m128 x) : v(x) {}
+  Float2(float x) : v(_mm_set1_ps(x)) {}
+  Float2(float a, float b) : v(_mm_setr_ps(a, b, a, b)) {}
+  void Store(float *p) const {
+    p[0] = _mm_cvtss_f32(v);
+    p[1] = _mm_cvtss_f32(_mm_shuffle_ps(v, v, 1));
+  }
+#else
+  float v[2];
+  Float2() {}
+  Float2(float x) { v[0] = v[1] = x; }
+  Float2(float a, float b) {
+    v[0] = a;
+    v[1] = b;
+  }
+  void Store(float *p) const {
+    p[0] = v[0];
+    p[1] = v[1];
+  }
+#endif
+};
+
+#if defined(SIMD_NEON)
+inline Float2 operator+(Float2 a, Float2 b) { return vadd_f32(a.v, b.v); }
+inline Float2 operator-(Float2 a, Float2 b) { return vsub_f32(a.v, b.v); }
+inline Float2 operator*(Float2 a, Float2 b) { return vmul_f32(a.v, b.v); }
+inline Float2 Min(Float2 a, Float2 b) { return vmin_f32(a.v, b.v); }
+inline Float2 Max(Float2 a, Float2 b) { return vmax_f32(a.v, b.v); }
+#elif defined(SIMD_SSE)
+inline Float2 operator+(Float2 a, Float2 b) { return _mm_add_ps(a.v, b.v); }
+inline Float2 operator-(Float2 a, Float2 b) { return _mm_sub_ps(a.v, b.v); }
+inline Float2 operator*(Float2 a, Float2 b) { return _mm_mul_ps(a.v, b.v); }
+inline Float2 Min(Float2 a, Float2 b) { return _mm_min_ps(a.v, b.v); }
+inline Float2 Max(Float2 a, Float2 b) { return _mm_max_ps(a.v, b.v); }
+#else
+inline Float2 operator+(Float2 a, Float2 b) {
+  return Float2(a.v[0] + b.v[0], a.v[1] + b.v[1]);
+}
+inline Float2 operator-(Float2 a, Float2 b) {
+  return Float2(a.v[0] - b.v[0], a.v[1] - b.v[1]);
+}
+inline Float2 operator*(Float2 a, Float2 b) {
+  return Float2(a.v[0] * b.v[0], a.v[1] * b.v[1]);
+}
+inline Float2 Min(Float2 a, Float2 b) {
+  return Float2(Min(a.v[0], b.v[0]), Min(a.v[1], b.v[1]));
+}
+inline Float2 Max(Float2 a, Float2 b) {
+  return Float2(Max(a.v[0], b.v[0]), Max(a.v[1], b.v[1]));
+}
+#endif
+
+inline Float2 &operator+=(Float2 &a, Float2 b) { return a = a + b; }
+inline Float2 &operator-=(Float2 &a, Float2 b) { return a = a - b; }
+inline Float2 &operator*=(Float2 &a, Float2 b) { return a = a * b; }
+
+// 4 float lanes
+struct Float4 {
+#if defined(SIMD_NEON)
+  float32x4_t v;
+  Float4() {}
+  Float4(float32x4_t x) : v(x) {}
+  Float4(float x) : v(vdupq_n_f32(x)) {}
+  static Float4 Load(const float *p) { return vld1q_f32(p); }
+  void Store(float *p) const { vst1q_f32(p, v); }
+  float Sum() const {
+    float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+  }
+#elif defined(SIMD_SSE)
+  __m128 v;
+  Float4() {}
+  Float4(__m128 x) : v(x) {}
+  Float4(float x) : v(_mm_set1_ps(x)) {}
+  static Float4 Load(const float *p) { return _mm_loadu_ps(p); }
+  void Store(float *p) const { _mm_storeu_ps(p, v); }
+  float Sum() const {
+    __m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+  }
+#else
+  float v[4];
+  Float4() {}
+  Float4(float x) { v[0] = v[1] = v[2] = v[3] = x; }
+  static Float4 Load(const float *p) {
+    Float4 r;
+    for (int i = 0; i < 4; i++) {
+      r.v[i] = p[i];
+    }
+    return r;
+  }
+  void Store(float *p) const {
+    for (int i = 0; i < 4; i++) {
+      p[i] = v[i];
+    }
+  }
+  float Sum() const { return (v[0] + v[1]) + (v[2] + v[3]); }
+#endif
+};
+
+#if defined(SIMD_NEON)
+inline Float4 operator+(Float4 a, Float4 b) { return vaddq_f32(a.v, b.v); }
+inline Float4 operator-(Float4 a, Float4 b) { return vsubq_f32(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return vmulq_f32(a.v, b.v); }
+inline Float4 CmpLt(Float4 a, Float4 b) {
+  return vreinterpretq_f32_u32(vcltq_f32(a.v, b.v));
+}
+inline Float4 CmpGt(Float4 a, Float4 b) {
+  return vreinterpretq_f32_u32(vcgtq_f32(a.v, b.v));
+}
+// a where mask is set, b elsewhere
+inline Float4 Select(Float4 mask, Float4 a, Float4 b) {
+  return vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v);
+}
+#elif defined(SIMD_SSE)
+inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline Float4 CmpLt(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline Float4 CmpGt(Float4 a, Float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+// a where mask is set, b elsewhere
+inline Float4 Select(Float4 mask, Float4 a, Float4 b) {
+  return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+#else
+// scalar masks are 1 or 0
+#define SIMD_FLOAT4_OP(expr)                                                   \
+  Float4 r;                                                                    \
+  for (int i = 0; i < 4; i++) {                                                \
+    r.v[i] = expr;                                                             \
+  }                                                                            \
+  return r;
+inline Float4 operator+(Float4 a, Float4 b) {
+  SIMD_FLOAT4_OP(a.v[i] + b.v[i])
+}
+inline Float4 operator-(Float4 a, Float4 b) {
+  SIMD_FLOAT4_OP(a.v[i] - b.v[i])
+}
+inline Float4 operator*(Float4 a, Float4 b) {
+  SIMD_FLOAT4_OP(a.v[i] * b.v[i])
+}
+inline Float4 CmpLt(Float4 a, Float4 b) {
+  SIMD_FLOAT4_OP(a.v[i] < b.v[i] ? 1.0f : 0.0f)
+}
+inline Float4 CmpGt(Float4 a, Float4 b) {
+  SIMD_FLOAT4_OP(a.v[i] > b.v[i] ? 1.0f : 0.0f)
+}
+// a where mask is set, b elsewhere
+inline Float4 Select(Float4 mask, Float4 a, Float4 b) {
+  SIMD_FLOAT4_OP(mask.v[i] != 0.0f ? a.v[i] : b.v[i])
+}
+#undef SIMD_FLOAT4_OP
+#endif
+
+inline Float4 &operator+=(Float4 &a, Float4 b) { return a = a + b; }
+inline Float4 &operator-=(Float4 &a, Float4 b) { return a = a - b; }
+inline Float4 &operator*=(Float4 &a, Float4 b) { return a = a * b; }
+
+// 8 float lanes
+struct Float8 {
+#if defined(SIMD_AVX)
+  __m256 v;
+  Float8() {}
+  Float8(__m256 x) : v(x) {}
+  Float8(float x) : v(_mm256_set1_ps(x)) {}
+  static Float8 Load(const float *p) { return _mm256_loadu_ps(p); }
+  void Store(float *p) const { _mm256_storeu_ps(p, v); }
+  float Sum() const {
+    Float4 s = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+    return s.Sum();
+  }
+#else
+  Float4 lo, hi;
+  Float8() {}
+  Float8(Float4 l, Float4 h) : lo(l), hi(h) {}
+  Float8(float x) : lo(x), hi(x) {}
+  static Float8 Load(const float *p) {
+    return Float8(Float4::Load(p), Float4::Load(p + 4));
+  }
+  void Store(float *p) const {
+    lo.Store(p);
+    hi.Store(p + 4);
+  }
+  float Sum() const { return (lo + hi).Sum(); }
+#endif
+};
+
+#if defined(SIMD_AVX)
+inline Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.v, b.v); }
+inline Float8 operator-(Float8 a, Float8 b) { return _mm256_sub_ps(a.v, b.v); }
+inline Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.v, b.v); }
+inline Float8 CmpLt(Float8 a, Float8 b) {
+  return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ);
+}
+inline Float8 CmpGt(Float8 a, Float8 b) {
+  return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ);
+}
+// a where mask is set, b elsewhere
+inline Float8 Select(Float8 mask, Float8 a, Float8 b) {
+  return _mm256_blendv_ps(b.v, a.v, mask.v);
+}
+#else
+inline Float8 operator+(Float8 a, Float8 b) {
+  return Float8(a.lo + b.lo, a.hi + b.hi);
+}
+inline Float8 operator-(Float8 a, Float8 b) {
+  return Float8(a.lo - b.lo, a.hi - b.hi);
+}
+inline Float8 operator*(Float8 a, Float8 b) {
+  return Float8(a.lo * b.lo, a.hi * b.hi);
+}
+inline Float8 CmpLt(Float8 a, Float8 b) {
+  return Float8(CmpLt(a.lo, b.lo), CmpLt(a.hi, b.hi));
+}
+inline Float8 CmpGt(Float8 a, Float8 b) {
+  return Float8(CmpGt(a.lo, b.lo), CmpGt(a.hi, b.hi));
+}
+// a where mask is set, b elsewhere
+inline Float8 Select(Float8 mask, Float8 a, Float8 b) {
+  return Float8(Select(mask.lo, a.lo, b.lo), Select(mask.hi, a.hi, b.hi));
+}
+#endif
+
+inline Float8 &operator+=(Float8 &a, Float8 b) { return a = a + b; }
+inline Float8 &operator-=(Float8 &a, Float8 b) { return a = a - b; }
+inline Float8 &operator*=(Float8 &a, Float8 b) { return a = a * b; }
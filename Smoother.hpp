@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Parameters that glide to new values instead of jumping
+//
+// Each one moves in a straight line to its target over the ramp time,
+// advanced once per block. Only the ones still moving are touched, so a
+// block where nothing changes costs nothing however many there are.
+// Per sample interpolation, where it's audible, is up to whoever uses the
+// value (eg the filter ramps its frequency across the block).
+// N is the number of parameters, they are numbered 0 to N - 1
+
+template <int N> class SmootherBank {
+public:
+  /**
+   * @param sr Sample rate
+   * @param rampTime Seconds to reach a new target
+   */
+  void Init(float sr, float rampTime) {
+    rampSamples_ = static_cast<uint32_t>(rampTime * sr);
+    rampSamples_ = rampSamples_ < 1 ? 1 : rampSamples_;
+    for (int i = 0; i < N; i++) {
+      values_[i] = 0.0f;
+      targets_[i] = 0.0f;
+      steps_[i] = 0.0f;
+      remaining_[i] = 0;
+    }
+    numActive_ = 0;
+    numChanged_ = 0;
+  }
+
+  // Jump straight to a value
+  void Reset(int i, float value) {
+    values_[i] = value;
+    targets_[i] = value;
+    remaining_[i] = 0;
+  }
+
+  // Start ramping to a new value from wherever it is now
+  void SetTarget(int i, float target) {
+    if (target == targets_[i]) {
+      return;
+    }
+    if (remaining_[i] == 0) {
+      active_[numActive_++] = i;
+    }
+    targets_[i] = target;
+    remaining_[i] = rampSamples_;
+    steps_[i] = (target - values_[i]) / rampSamples_;
+  }
+
+  // Move everything that's ramping forward by size samples, the ones that
+  // moved are listed by GetChanged
+  void Process(size_t size) {
+    numChanged_ = 0;
+    int stillActive = 0;
+    for (int a = 0; a < numActive_; a++) {
+      int i = active_[a];
+      changed_[numChanged_++] = i;
+      if (remaining_[i] > size) {
+        remaining_[i] -= size;
+        values_[i] += steps_[i] * size;
+        active_[stillActive++] = i;
+      } else {
+        // land exactly on the target
+        remaining_[i] = 0;
+        values_[i] = targets_[i];
+      }
+    }
+    numActive_ = stillActive;
+  }
+
+  float Get(int i) { return values_[i]; }
+  int GetNumChanged() { return numChanged_; }
+  // parameter number of the n-th one that moved in the last Process
+  int GetChanged(int n) { return changed_[n]; }
+
+private:
+  uint32_t rampSamples_;
+  float values_[N], targets_[N], steps_[N];
+  uint32_t remaining_[N]; // samples left in the ramp, 0 when still
+  // the ones still ramping
+  int active_[N];
+  int numActive_;
+  // the ones that moved in the last Process
+  int changed_[N];
+  int numChanged_;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Queue from one thread to another without locks, eg from the main loop to
+// the audio callback. Only one side may push and only one side may pop.
+// N is a power of 2, one slot is always left empty
+// Smallest N that holds items at once
+constexpr size_t SpscQueueSize(size_t items) {
+  size_t n = 1;
+  while (n < items + 1) {
+    n <<= 1;
+  }
+  return n;
+}
+
+template <typename T, size_t N> class SpscQueue {
+public:
+  static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of 2");
+
+  SpscQueue() : head_(0), tail_(0) {}
+
+  // Producer side, false when full
+  bool Push(const T &item) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t next = (head + 1) & (N - 1);
+    if (next == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    items_[head] = item;
+    // the item has to be written before the consumer can see it
+    head_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, false when empty
+  bool Pop(T &item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items_[tail];
+    tail_.store((tail + 1) & (N - 1), std::memory_order_release);
+    return true;
+  }
+
+  bool IsEmpty() {
+    return tail_.load(std::memory_order_acquire) ==
+           head_.load(std::memory_order_acquire);
+  }
+
+private:
+  T items_[N];
+  std::atomic<size_t> head_; // next slot to write, only the producer moves it
+  std::atomic<size_t> tail_; // next slot to read, only the consumer moves it
+};
@@ -1,40 +1,44 @@
-#include "Envelope.hpp"
 #include "FieldWrap.hpp"
-#include "Filter.hpp"
-#include "Oscillator.hpp"
+#include "Governor.hpp"
+#include "Screen.hpp"
+#include "SpscQueue.hpp"
+#include "Synth.hpp"
 #include "daisy_field.h"
 #include "hid/midi_parser.h"
-#include <string>
 
 using namespace daisy;
 
-// adding delay to the main while the block size is small (1 or 2)
-// makes the controls sluggish, I don't know why yet
-#define MAIN_DELAY 10 // ms, main loop iteration time (separate from audio)
+// at very small block sizes (1 or 2) the callback runs so often that its
+// cost per block leaves the main loop little time and the controls get
+// sluggish, the smallest audio profile is 4 samples for that reason
+#define MAIN_DELAY 10 // ms, between control and display updates
 #define DISPLAY_UPDATE_DELAY 10 // update display every x main iterations
 
 FieldWrap hw;
 CpuLoadMeter cpuLoad;
+// steps the synth quality down before the callback runs out of time
+Governor governor;
+// System::GetTick ticks to a fraction of the block period
+float ticksToLoad;
+
+Synth synth;
+
+// MIDI read in the main loop for the audio callback, stamped with when it
+// was read
+struct TimedMidi {
+  uint32_t time; // us
+  Synth::EventType type;
+  uint8_t data1, data2;
+};
+SpscQueue<TimedMidi, 64> midiQueue;
+// when the last audio block started, us
+uint32_t lastBlockTime = 0;
+// time between blocks as measured, us, smoothed for the latency readout
+float blockPeriod = 0.0f;
 
-Oscillator osc;
-Filter filter1;
-Filter filter2;
-Envelope env1;
-Envelope env2;
-
-// audio
-float out1, out2;
 //
 float samplerate;
 uint8_t blocksize;
-// set by knob in main, used by midi note on
-int transpose = 0;
-// pitch slide
-float currentNote = 0.0f;
-float targetNote = 0.0f;
-bool noteHeld = false;
-float glideTime = 0.05f; // seconds
-float glideStep = 0.0f;
 //
 bool switch1 = false;
 
@@ -42,113 +46,110 @@ void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out,
                    size_t size) {
 
   cpuLoad.OnBlockStart();
-
-  // MIDI can be done once per block
-  hw.ListenMidi();
-  while (hw.MidiHasEvents()) {
-    MidiEvent m = hw.PopMidiEvent();
-
-    switch (m.type) {
-
-    case NoteOn: {
-      uint8_t note = m.data[0];
-      uint8_t velocity = m.data[1];
-
-      if (velocity > 0) {
-        note = note + transpose;
-        targetNote = note;
-        if (!noteHeld) {
-          currentNote = targetNote;
-          osc.SetNote(currentNote);
-          env1.Trigger();
-          env2.Trigger();
-          noteHeld = true;
-        } else {
-          // linear scale because these are MIDI notes
-          // (converted in osc class)
-          glideStep =
-              (targetNote - currentNote) / (glideTime * samplerate) * blocksize;
-        }
-      }
-      break;
-    }
-    case NoteOff: {
-      noteHeld = false;
-      // don't need to release the envelope
-      break;
-    }
-    case ControlChange: {
-      uint8_t cc = m.data[0];    // CC number
-      uint8_t value = m.data[1]; // CC value
-      // CC 14 for filter envelope attack
-      if (cc == 14) {
-        float addAttack = (value / 127.0f) * 5.0f;
-        env2.AddAttack(
-            (addAttack < 0.0f) ? 0.0f : (addAttack > 5.0f ? 5.0f : addAttack));
-      }
-      // CC 15 for filter envelope decay
-      if (cc == 15) {
-        float addDecay = (value / 127.0f) * 5.0f;
-        env2.AddDecay((addDecay < 0.0f) ? 0.0f
-                                        : (addDecay > 5.0f ? 5.0f : addDecay));
-      }
-      break;
-    }
-    default:
-      break;
+  uint32_t startTick = System::GetTick();
+
+  // MIDI read during the last block lands at the same offset in this one,
+  // always one block late but without jitter
+  uint32_t now = System::GetUs();
+  {
+    PROFILE_SCOPE(PROFILE_MIDI);
+    const float samplesPerUs = samplerate * 0.000001f;
+    TimedMidi m;
+    while (midiQueue.Pop(m)) {
+      int32_t age = static_cast<int32_t>(m.time - lastBlockTime);
+      Synth::Event event;
+      event.offset = age > 0 ? static_cast<size_t>(age * samplesPerUs) : 0;
+      event.type = m.type;
+      event.data1 = m.data1;
+      event.data2 = m.data2;
+      synth.QueueEvent(event);
     }
   }
+  float period = static_cast<float>(now - lastBlockTime);
+  blockPeriod += 0.01f * (period - blockPeriod);
+  lastBlockTime = now;
 
-  // pitch slide (calculating pitch slide every sample
-  // (or having blocks to small) causes noise
-  if ((glideStep > 0.0f && currentNote < targetNote) ||
-      (glideStep < 0.0f && currentNote > targetNote)) {
-    currentNote += glideStep;
-  } else {
-    currentNote = targetNote;
+  synth.Process(out[0], out[1], size);
+
+  // the new tier is there for the next block
+  float load = (System::GetTick() - startTick) * ticksToLoad;
+  if (governor.Process(load)) {
+    synth.SetQuality(governor.GetTier());
   }
 
-  for (size_t i = 0; i < size; i++) {
+  PROFILE_END_BLOCK();
+  cpuLoad.OnBlockEnd();
+}
 
-    float env1Out = env1.Process();
-    float env2Out = env2.Process();
-    osc.SetAmp(env1Out);
-    osc.SetNote(currentNote);
-    osc.Process(&out1, &out2);
-    filter1.AddFreq(env2Out);
-    filter2.AddFreq(env2Out);
-    out1 = filter1.Process(out1 * 0.50f);
-    out2 = filter2.Process(out2 * 0.50f);
+// everything that depends on the sample rate and block size, while the
+// audio is stopped
+void SetupAudio() {
+  samplerate = hw.Field().AudioSampleRate();
+  blocksize = hw.Field().AudioBlockSize();
+  cpuLoad.Init(samplerate, blocksize);
+  ticksToLoad = samplerate / (blocksize * float(System::GetTickFreq()));
+  // the readout starts from what it should be
+  blockPeriod = blocksize / samplerate * 1000000.0f;
+  lastBlockTime = System::GetUs();
+}
 
-    out[0][i] = out1;
-    out[1][i] = out2;
-  }
+// after the synth setup, the governor only gets the tiers that save
+// something with it
+void SetupGovernor() {
+  governor.Init(samplerate / blocksize, synth.GetNumQualityTiers());
+  synth.SetQuality(governor.GetTier());
+}
 
-  cpuLoad.OnBlockEnd();
+// switch the sample rate and block size, the knob settings stay
+void SwitchAudioProfile(int profile) {
+  hw.SetAudioProfile(profile);
+  SetupAudio();
+  // the filter tables for the new rate are copied to DTCM here
+  synth.SetSampleRate(samplerate);
+  synth.SetFilterOversampling(
+      GetAudioProfileConfig(profile).filterOversampling);
+  SetupGovernor();
+  hw.StartAudio();
 }
 
+#ifdef SWARM_PROFILE
+// cycles in at most 3 characters so the profile page columns fit before the
+// histograms: as they are up to 999, then in thousands and past 100k in
+// tenths of a million (a whole block at 48k/32 is 320k)
+void AppendCycles(Screen::Text &text, uint32_t cycles) {
+  if (cycles < 1000) {
+    text.AppendInt(static_cast<int>(cycles));
+  } else if (cycles < 100000) {
+    text.AppendInt(static_cast<int>(cycles / 1000)).Append("k");
+  } else {
+    uint32_t tenths = cycles / 100000;
+    text.Append(".").AppendInt(static_cast<int>(tenths > 9 ? 9 : tenths));
+    text.Append("M");
+  }
+}
+#endif
+
 int main(void) {
 
+  Profiler::Init();
   hw.Init(AudioCallback);
   hw.InitMidi();
-  samplerate = hw.Field().AudioSampleRate();
-  blocksize = hw.Field().AudioBlockSize();
-  osc.Init(samplerate);
-  filter1.Init(samplerate);
-  filter2.Init(samplerate);
-  env1.Init(samplerate);
-  env1.SetCurve(2.5f);
-  env2.Init(samplerate);
-  env2.SetCurve(2.0f);
-  cpuLoad.Init(samplerate, blocksize);
+  SetupAudio();
+  synth.Init(samplerate);
+  synth.SetFilterOversampling(
+      GetAudioProfileConfig(hw.GetAudioProfile()).filterOversampling);
+  SetupGovernor();
+  // the lfo knobs set how much goes down these routes, 0 is off
+  enum { ROUTE_LFO_FILTER = 0, ROUTE_LFO_PITCH, ROUTE_LFO_PAN };
 
   // main loop iterations
   uint8_t mainCount = 0;
+  uint32_t lastUpdate = 0;
   //
-  std::string uiLabels1[8] = {"Trns", "EnvA", "EnvD", "FltF",
+  const char *uiLabels1[8] = {"Trns", "EnvA", "EnvD", "FltF",
                               "FltQ", "FEnA", "FEnD", "FEnS"};
-  std::string uiLabels2[8] = {"Dtun", "Crv1", "Crv2", "PSld", "", "", "", ""};
-  std::string uiValues[8] = {"", "", "", "", "", "", "", ""};
+  const char *uiLabels2[8] = {"Dtun", "Crv1", "Crv2", "PSld",
+                              "LRat", "LFlt", "LPit", "LPan"};
 
   // y position of text rows on screen
   uint8_t row1 = 0;
@@ -156,153 +157,312 @@ int main(void) {
   uint8_t row3 = 19;
   uint8_t row4 = 30;
   uint8_t row5 = 38;
-  // uint8_t row6 = 48;
+  uint8_t row6 = 48;
   uint8_t row7 = 56;
   // offset so the columns are centered
   uint8_t screenOffset = 6;
 
+  // the knob page, only the cells that change are redrawn
+  Screen mainScreen;
+  // the CPU readout comes first on every page, cells 0 and 1
+  const int cpuAvgCell = mainScreen.AddCell(0, row1);
+  const int cpuMaxCell = mainScreen.AddCell(68, row1);
+  int labelCells[8], valueCells[8];
+  for (int i = 0; i < 8; i++) {
+    uint8_t xPos = i * 30 + screenOffset; // + offset to center
+    uint8_t yPosLabel = row2;
+    uint8_t yPosValue = row3;
+    // second row
+    if (i > 3) {
+      xPos = xPos - (4 * 30);
+      yPosLabel = row4;
+      yPosValue = row5;
+    }
+    labelCells[i] = mainScreen.AddCell(xPos, yPosLabel);
+    valueCells[i] = mainScreen.AddCell(xPos, yPosValue);
+  }
+  // the audio profile, latency from a note to the output and how much of
+  // the CPU is left at the worst block
+  const int profileCell = mainScreen.AddCell(0, row6);
+  const int latencyCell = mainScreen.AddCell(42, row6);
+  const int headroomCell = mainScreen.AddCell(92, row6);
+  const int sw1Cell = mainScreen.AddCell(screenOffset, row7);
+  // the governor's quality tier, 0 is full
+  const int tierCell = mainScreen.AddCell(68, row7);
+  Screen *shownScreen = nullptr;
+  Screen::Text text;
+
+#ifdef SWARM_PROFILE
+  bool switch2 = false;
+  // the profile page, a row per stage with the histogram next to it. The
+  // numbers are 3 characters wide (see AppendCycles), the last column ends
+  // at x=90 and the histograms start at 94
+  Screen profileScreen;
+  const uint8_t profileColumns[4] = {0, 28, 50, 72};
+  const char *profileHeaders[3] = {"min", "avg", "max"};
+  for (int c = 0; c < 3; c++) {
+    profileScreen.SetText(profileScreen.AddCell(profileColumns[c + 1], row1),
+                          profileHeaders[c]);
+  }
+  int stageCells[PROFILE_NUM_STAGES][4];
+  for (int s = 0; s < PROFILE_NUM_STAGES; s++) {
+    uint8_t y = row2 + s * 10;
+    for (int c = 0; c < 4; c++) {
+      stageCells[s][c] = profileScreen.AddCell(profileColumns[c], y);
+    }
+    profileScreen.SetText(stageCells[s][0], Profiler::GetStageName(s));
+  }
+#endif
+
   while (1) {
 
+    // MIDI is read as often as possible so the timestamps are tight
+    hw.ListenMidi();
+    while (hw.MidiHasEvents()) {
+      MidiEvent event = hw.PopMidiEvent();
+      TimedMidi m;
+      m.time = System::GetUs();
+      m.data1 = event.data[0];
+      m.data2 = event.data[1];
+      if (event.type == NoteOn) {
+        m.type = Synth::NOTE_ON;
+      } else if (event.type == NoteOff) {
+        m.type = Synth::NOTE_OFF;
+      } else if (event.type == ControlChange) {
+        m.type = Synth::CC;
+      } else {
+        continue;
+      }
+      midiQueue.Push(m);
+    }
+
+    // the rest runs every MAIN_DELAY ms
+    if (System::GetNow() - lastUpdate < MAIN_DELAY) {
+      continue;
+    }
+    lastUpdate = System::GetNow();
     ++mainCount;
 
     hw.ProcessAllControls();
 
-    switch1 = hw.SwitchPressed(1);
-
-    for (size_t i = 0; i < 8; i++) {
-      if (hw.DidKnobChange(i)) {
-        if (!switch1) {
-          switch (i) {
-          case 0:
-            // knob 1, transpose
-            transpose = static_cast<int>(hw.ScaleKnob(i, -24.0f, 24.0f));
-            break;
-          case 1:
-            // knob 2, env1 attack
-            env1.SetAttack(hw.ScaleKnob(i, 0.001f, 5.1f, true));
-            break;
-          case 2:
-            // knob 3, env1 decay
-            env1.SetDecay(hw.ScaleKnob(i, 0.001f, 5.1f, true));
-            break;
-          case 3:
-            // knob 4, filter frequency (index)
-            filter1.SetFreq(hw.ScaleKnob(i, 0.0f, 1.0f));
-            filter2.SetFreq(hw.ScaleKnob(i, 0.0f, 1.0f));
-            break;
-          case 4:
-            // knob 5, filter q
-            filter1.SetQ(hw.ScaleKnob(i, 0.0f, 1.0f));
-            filter2.SetQ(hw.ScaleKnob(i, 0.0f, 1.0f));
-            break;
-          case 5:
-            // knob 6, env2 attack
-            env2.SetAttack(hw.ScaleKnob(i, 0.001f, 5.1f, true));
-            break;
-          case 6:
-            // knob 7, env2 decay
-            env2.SetDecay(hw.ScaleKnob(i, 0.001f, 5.1f, true));
-            break;
-          case 7:
-            // knob 8, env2 scale
-            env2.SetScale(hw.ScaleKnob(i, 0.0f, 1.0f));
-            break;
-          }
+    // every knob and switch that changed since the last pass, all of them
+    // are scanned every time so moving more knobs doesn't slow any down
+    while (hw.ControlHasEvents()) {
+      ControlEvent event = hw.PopControlEvent();
+      if (event.type != ControlEvent::KNOB) {
+        bool pressed = event.type == ControlEvent::SWITCH_PRESSED;
+        if (event.index == 1) {
+          switch1 = pressed;
+        }
+        // switch 1 held and switch 2 goes to the next audio profile
+        if (event.index == 2 && pressed && switch1) {
+          SwitchAudioProfile((hw.GetAudioProfile() + 1) % AUDIO_NUM_PROFILES);
+          continue;
         }
-        if (switch1) {
-          switch (i) {
-          case 0:
-            // knob 1, detune
-            osc.SetDetune(hw.ScaleKnob(i, 0.01f, 1.0f));
-            break;
-          case 1:
-            // knob 2, amplitude envelope curve
-            env1.SetCurve(hw.ScaleKnob(i, 1.0f, 4.0f));
-            break;
-          case 2:
-            // knob 3, filter envelope curve
-            env2.SetCurve(hw.ScaleKnob(i, 1.0f, 4.0f));
-            break;
-          case 3:
-            // knob 4, pitch slide time
-            glideTime = hw.ScaleKnob(i, 0.0f, 2.0f);
-            break;
+#ifdef SWARM_PROFILE
+        if (event.index == 2) {
+          // fresh numbers every time the profile page is opened
+          if (pressed) {
+            Profiler::Get().Reset();
           }
+          switch2 = pressed;
+        }
+#endif
+        continue;
+      }
+      size_t i = event.index;
+      if (!switch1) {
+        switch (i) {
+        case 0:
+          // knob 1, transpose
+          synth.SetTranspose(static_cast<int>(hw.ScaleKnob(i, -24.0f, 24.0f)));
+          break;
+        case 1:
+          // knob 2, env1 attack
+          synth.SetAttack(hw.ScaleKnob(i, 0.001f, 5.1f, true));
+          break;
+        case 2:
+          // knob 3, env1 decay
+          synth.SetDecay(hw.ScaleKnob(i, 0.001f, 5.1f, true));
+          break;
+        case 3:
+          // knob 4, filter frequency (index)
+          synth.SetFilterFreq(hw.ScaleKnob(i, 0.0f, 1.0f));
+          break;
+        case 4:
+          // knob 5, filter q
+          synth.SetFilterQ(hw.ScaleKnob(i, 0.0f, 1.0f));
+          break;
+        case 5:
+          // knob 6, env2 attack
+          synth.SetFilterAttack(hw.ScaleKnob(i, 0.001f, 5.1f, true));
+          break;
+        case 6:
+          // knob 7, env2 decay
+          synth.SetFilterDecay(hw.ScaleKnob(i, 0.001f, 5.1f, true));
+          break;
+        case 7:
+          // knob 8, env2 scale
+          synth.SetFilterScale(hw.ScaleKnob(i, 0.0f, 1.0f));
+          break;
+        }
+      }
+      if (switch1) {
+        switch (i) {
+        case 0:
+          // knob 1, detune
+          synth.SetDetune(hw.ScaleKnob(i, 0.01f, 1.0f));
+          break;
+        case 1:
+          // knob 2, amplitude envelope curve
+          synth.SetCurve(hw.ScaleKnob(i, 1.0f, 4.0f));
+          break;
+        case 2:
+          // knob 3, filter envelope curve
+          synth.SetFilterCurve(hw.ScaleKnob(i, 1.0f, 4.0f));
+          break;
+        case 3:
+          // knob 4, pitch slide time
+          synth.SetGlideTime(hw.ScaleKnob(i, 0.0f, 2.0f));
+          break;
+        case 4:
+          // knob 5, lfo rate
+          synth.SetLfoRate(0, hw.ScaleKnob(i, 0.05f, 20.0f, true));
+          break;
+        case 5:
+          // knob 6, lfo to filter frequency (index)
+          synth.SetModRoute(ROUTE_LFO_FILTER, MOD_SRC_LFO1, MOD_DST_FILTER_FREQ,
+                            hw.ScaleKnob(i, 0.0f, 0.5f));
+          break;
+        case 6:
+          // knob 7, lfo to pitch, up to a semitone each way
+          synth.SetModRoute(ROUTE_LFO_PITCH, MOD_SRC_LFO1, MOD_DST_PITCH,
+                            hw.ScaleKnob(i, 0.0f, 1.0f));
+          break;
+        case 7:
+          // knob 8, lfo to the pan spread of the saws
+          synth.SetModRoute(ROUTE_LFO_PAN, MOD_SRC_LFO1, MOD_DST_PAN_SPREAD,
+                            hw.ScaleKnob(i, 0.0f, 1.0f));
+          break;
         }
       }
     }
 
+    // the audio callback picks the changes up at its next block
+    synth.CommitParams();
+
     // update display every x iterations
     if (mainCount % DISPLAY_UPDATE_DELAY == 0) {
 
-      hw.ClearDisplay();
+      Screen *screen = &mainScreen;
+#ifdef SWARM_PROFILE
+      screen = switch2 ? &profileScreen : &mainScreen;
+#endif
+      // a new page starts from a blank display
+      if (screen != shownScreen) {
+        hw.ClearDisplay();
+        screen->Invalidate();
+        shownScreen = screen;
+      }
 
-      std::string cpuAvgStr =
-          "CPUAvg:" +
-          std::to_string(static_cast<int>(cpuLoad.GetAvgCpuLoad() * 100)) +
-          "% ";
-      std::string cpuMaxStr =
-          "CPUMax:" +
-          std::to_string(static_cast<int>(cpuLoad.GetMaxCpuLoad() * 100)) +
-          "% ";
-      hw.PrintToScreen(cpuAvgStr.c_str(), 0, row1);
-      hw.PrintToScreen(cpuMaxStr.c_str(), 68, row1);
+      text.Set("CPUAvg:");
+      text.AppendInt(static_cast<int>(cpuLoad.GetAvgCpuLoad() * 100));
+      screen->SetText(cpuAvgCell, text.Append("% ").Get());
+      text.Set("CPUMax:");
+      text.AppendInt(static_cast<int>(cpuLoad.GetMaxCpuLoad() * 100));
+      screen->SetText(cpuMaxCell, text.Append("% ").Get());
+
+#ifdef SWARM_PROFILE
+      // switch 2 shows what each stage takes per block in cycles, min,
+      // average, max and a histogram from 64 cycles up, one bar per doubling
+      if (switch2) {
+        for (int s = 0; s < PROFILE_NUM_STAGES; s++) {
+          const Profiler::Stats &stats = Profiler::Get().GetStats(s);
+          uint8_t y = row2 + s * 10;
+          // min starts out at the max uint32_t until a block is counted
+          uint32_t values[3] = {stats.blocks > 0 ? stats.min : 0,
+                                static_cast<uint32_t>(stats.GetAvg()),
+                                stats.max};
+          for (int c = 0; c < 3; c++) {
+            text.Clear();
+            AppendCycles(text, values[c]);
+            profileScreen.SetText(stageCells[s][c + 1], text.Get());
+          }
+          // the histograms move all the time, always redrawn
+          uint32_t most = 1;
+          for (int b = 0; b < PROFILE_HISTOGRAM_BINS; b++) {
+            most = stats.histogram[b] > most ? stats.histogram[b] : most;
+          }
+          hw.ClearRect(94, y, 94 + PROFILE_HISTOGRAM_BINS * 2, y + 7);
+          for (int b = 0; b < PROFILE_HISTOGRAM_BINS; b++) {
+            uint8_t height = stats.histogram[b] * 7 / most;
+            if (height > 0) {
+              uint8_t x = 94 + b * 2;
+              hw.DrawRect(x, y + 7 - height, x, y + 7);
+            }
+          }
+        }
+        profileScreen.Draw(hw);
+        hw.UpdateDisplay();
+        continue;
+      }
+#endif
 
       // floats cause problems so I multiply and cast to int
+      int values[8] = {};
       if (!switch1) {
-        uiValues[0] = std::to_string(transpose);
-        uiValues[1] = std::to_string(static_cast<int>(env1.GetAttack() * 100));
-        uiValues[2] = std::to_string(static_cast<int>(env1.GetDecay() * 100));
-        float filtFreq = filter1.GetFreq();
-        if (filtFreq < 10000.f) {
-          uiValues[3] = std::to_string(static_cast<int>(filtFreq));
-        } else {
-          uiValues[3] = std::to_string(static_cast<int>(filtFreq / 1000));
-          uiValues[3].append("k");
-        }
-        uiValues[4] = std::to_string(static_cast<int>(filter1.GetQ() * 100));
-
-        uiValues[5] = std::to_string(static_cast<int>(env2.GetAttack() * 100));
-        uiValues[6] = std::to_string(static_cast<int>(env2.GetDecay() * 100));
-        uiValues[7] = std::to_string(static_cast<int>(env2.GetScale() * 100));
+        values[0] = synth.GetTranspose();
+        values[1] = static_cast<int>(synth.GetAttack() * 100);
+        values[2] = static_cast<int>(synth.GetDecay() * 100);
+        values[3] = static_cast<int>(synth.GetFilterFreq());
+        values[4] = static_cast<int>(synth.GetFilterQ() * 100);
+        values[5] = static_cast<int>(synth.GetFilterAttack() * 100);
+        values[6] = static_cast<int>(synth.GetFilterDecay() * 100);
+        values[7] = static_cast<int>(synth.GetFilterScale() * 100);
       } else {
-        uiValues[0] = std::to_string(static_cast<int>(osc.GetDetune() * 100));
-        uiValues[1] = std::to_string(static_cast<int>(env1.GetCurve() * 100));
-        uiValues[2] = std::to_string(static_cast<int>(env2.GetCurve() * 100));
-        uiValues[3] = std::to_string(static_cast<int>(glideTime * 100));
-        uiValues[4] = "";
-        uiValues[5] = "";
-        uiValues[6] = "";
-        uiValues[7] = "";
+        values[0] = static_cast<int>(synth.GetDetune() * 100);
+        values[1] = static_cast<int>(synth.GetCurve() * 100);
+        values[2] = static_cast<int>(synth.GetFilterCurve() * 100);
+        values[3] = static_cast<int>(synth.GetGlideTime() * 100);
+        values[4] = static_cast<int>(synth.GetLfoRate(0) * 100);
+        values[5] = static_cast<int>(
+            synth.GetModRoute(ROUTE_LFO_FILTER).amount * 100);
+        values[6] =
+            static_cast<int>(synth.GetModRoute(ROUTE_LFO_PITCH).amount * 100);
+        values[7] =
+            static_cast<int>(synth.GetModRoute(ROUTE_LFO_PAN).amount * 100);
       }
 
       for (int i = 0; i < 8; i++) {
-        uint8_t xPos = i * 30 + screenOffset; // + offset to center
-        uint8_t yPosLabel = row2;
-        uint8_t yPosValue = row3;
-        // second row
-        if (i > 3) {
-          xPos = xPos - (4 * 30);
-          yPosLabel = row4;
-          yPosValue = row5;
-        }
-        if (!switch1) {
-          hw.PrintToScreen(uiLabels1[i].c_str(), xPos, yPosLabel);
+        mainScreen.SetText(labelCells[i],
+                           !switch1 ? uiLabels1[i] : uiLabels2[i]);
+        text.Clear();
+        if (!switch1 && i == 3 && values[3] >= 10000) {
+          // filter frequency in kHz
+          text.AppendInt(values[3] / 1000).Append('k');
         } else {
-          hw.PrintToScreen(uiLabels2[i].c_str(), xPos, yPosLabel);
+          text.AppendInt(values[i]);
         }
-        hw.PrintToScreen(uiValues[i].c_str(), xPos, yPosValue);
+        mainScreen.SetText(valueCells[i], text.Get());
       }
-
-      if (switch1) {
-        char sw1[4] = "SW1";
-        hw.PrintToScreen(sw1, screenOffset, row7);
+      mainScreen.SetText(profileCell,
+                         GetAudioProfileConfig(hw.GetAudioProfile()).name);
+      text.Set("L:");
+      text.AppendInt(static_cast<int>(GetAudioLatency(blockPeriod)));
+      mainScreen.SetText(latencyCell, text.Append("us").Get());
+      text.Set("HR:");
+      text.AppendInt(
+          static_cast<int>((1.0f - cpuLoad.GetMaxCpuLoad()) * 100));
+      mainScreen.SetText(headroomCell, text.Append('%').Get());
+      mainScreen.SetText(sw1Cell, switch1 ? "SW1" : "");
+      text.Set("Tier:");
+      text.AppendInt(governor.GetTier());
+      mainScreen.SetText(tierCell, text.Get());
+
+      // nothing is sent when nothing changed
+      if (mainScreen.Draw(hw)) {
+        hw.UpdateDisplay();
       }
-
-      hw.UpdateDisplay();
     }
-
-    // slow down the main thread
-    System::Delay(MAIN_DELAY);
   }
 }
\ No newline at end of file
@@ -0,0 +1,718 @@
+#pragma once
+
+#include "Modulation.hpp"
+#include "Profiler.hpp"
+#include "Smoother.hpp"
+#include "TripleBuffer.hpp"
+#include "Voice.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// number of voices, each one is a whole swarm so keep an eye on the CPU
+#ifndef SWARM_VOICES
+#define SWARM_VOICES 1
+#endif
+
+// most MIDI messages one Process call takes, more are applied right away
+#define SYNTH_MAX_EVENTS 32
+
+// seconds for the knob driven parameters to glide to a new value
+#define SYNTH_SMOOTH_TIME 0.02f
+
+// Everything the main loop sets, with the slow maths already done
+struct SynthParams {
+  int transpose;
+  float glideTime; // seconds
+  float detune;
+  float filterFreq, filterQ; // indexes, 0 to 1
+  float attack, decay;
+  CurveTable curve;
+  float filterAttack, filterDecay, filterScale;
+  CurveTable filterCurve;
+  float lfoRate[MOD_NUM_LFOS]; // Hz
+  Lfo::Shape lfoShape[MOD_NUM_LFOS];
+  ModMatrix mod;
+};
+
+// The whole voice graph that the audio callback plays
+// it doesn't know about libDaisy so it can also be rendered on a computer
+class Synth {
+public:
+  Synth() {}
+  ~Synth() {}
+
+  enum VoiceMode {
+    MONO = 0, // one voice, notes played legato slide instead of retriggering
+    POLY,     // a voice per note
+  };
+
+  // which voice a new note takes when they are all busy
+  enum StealMode {
+    STEAL_OLDEST = 0,
+    STEAL_QUIETEST,
+  };
+
+  // MIDI message types for QueueEvent
+  enum EventType {
+    NOTE_ON = 0,
+    NOTE_OFF,
+    CC,
+  };
+
+  struct Event {
+    size_t offset; // samples into the next Process call
+    EventType type;
+    uint8_t data1, data2;
+  };
+
+  // what SetQuality takes away, in order, each tier also has the ones
+  // before it. A step that changes nothing for the setup (the filter
+  // already at 1x, only one voice) is skipped, so tier 1 is the first one
+  // that does something, see GetNumQualityTiers
+  enum QualityStep {
+    QUALITY_LESS_OVERSAMPLING = 0, // half the filter oversampling
+    QUALITY_HALF_VOICES,           // new notes only get half of the voices
+    NUM_QUALITY_STEPS,
+  };
+
+  void Init(float sr) {
+    for (size_t i = 0; i < numVoices_; i++) {
+      voices_[i].Init(sr);
+    }
+    oversampling_ = 1;
+    quality_ = 0;
+    activeVoices_ = numVoices_;
+    numEvents_ = 0;
+    voiceMode_ = numVoices_ > 1 ? POLY : MONO;
+    stealMode_ = STEAL_OLDEST;
+    noteHeld_ = false;
+    noteCount_ = 0;
+
+    params_.transpose = 0;
+    params_.glideTime = 0.05f;
+    params_.detune = 0.0f;
+    params_.filterFreq = 0.5f;
+    params_.filterQ = 0.2f;
+    params_.attack = 0.1f;
+    params_.decay = 1.0f;
+    params_.curve.Set(2.5f);
+    params_.filterAttack = 0.1f;
+    params_.filterDecay = 1.0f;
+    params_.filterScale = 1.0f;
+    params_.filterCurve.Set(2.0f);
+    for (int i = 0; i < MOD_NUM_LFOS; i++) {
+      params_.lfoRate[i] = 1.0f;
+      params_.lfoShape[i] = Lfo::SINE;
+      lfos_[i].Init(sr);
+    }
+    params_.mod.Clear();
+    // nothing else is running yet, so take them straight away
+    paramsChanged_ = true;
+    CommitParams();
+    paramBuffer_.Update();
+    startAudioSide(sr);
+  }
+
+  /**
+   * Work out everything that depends on the sample rate again, eg for a
+   * new audio profile. The parameters and the setup (oscillator mode,
+   * oversampling, envelope rate) stay, playing notes stop.
+   * Not while Process can run, stop the audio first
+   */
+  void SetSampleRate(float sr) {
+    Oscillator::Mode oscMode = GetOscMode();
+    Envelope::RateMode envMode = voices_[0].Env1().GetRateMode();
+    size_t envInterval = voices_[0].Env1().GetRateInterval();
+    for (size_t i = 0; i < numVoices_; i++) {
+      voices_[i].Init(sr);
+    }
+    SetOscMode(oscMode);
+    SetFilterOversampling(oversampling_);
+    SetEnvelopeMode(envMode, envInterval);
+    numEvents_ = 0;
+    noteHeld_ = false;
+    for (int i = 0; i < MOD_NUM_LFOS; i++) {
+      lfos_[i].Init(sr);
+    }
+    // whatever the main loop committed last
+    paramBuffer_.Update();
+    startAudioSide(sr);
+  }
+
+  void SetVoiceMode(VoiceMode mode) { voiceMode_ = mode; }
+  VoiceMode GetVoiceMode() { return voiceMode_; }
+  void SetStealMode(StealMode mode) { stealMode_ = mode; }
+
+  /**
+   * MIDI
+   */
+
+  void NoteOn(uint8_t note, uint8_t velocity) {
+    if (velocity == 0) {
+      return;
+    }
+    uint8_t key = note;
+    note = note + transpose_;
+
+    if (voiceMode_ == MONO) {
+      if (!noteHeld_) {
+        voices_[0].Trigger(note);
+        noteHeld_ = true;
+      } else {
+        voices_[0].Glide(note, glideTime_);
+      }
+      voices_[0].SetKey(key);
+      return;
+    }
+
+    Voice &voice = allocVoice(key);
+    voice.Trigger(note);
+    voice.SetKey(key);
+    voice.SetHeld(true);
+    voice.SetAge(++noteCount_);
+  }
+
+  void NoteOff(uint8_t note) {
+    // match on the key as played, the transpose may have moved since
+    // don't need to release the envelopes, mono legato only ends when the
+    // key voice 0 is playing comes up
+    if (voices_[0].GetKey() == note) {
+      noteHeld_ = false;
+    }
+    for (size_t i = 0; i < numVoices_; i++) {
+      if (voices_[i].GetKey() == note) {
+        voices_[i].SetHeld(false);
+      }
+    }
+  }
+
+  void ControlChange(uint8_t cc, uint8_t value) {
+    for (size_t i = 0; i < numVoices_; i++) {
+      // CC 14 for filter envelope attack
+      if (cc == 14) {
+        voices_[i].Env2().AddAttack((value / 127.0f) * 5.0f);
+      }
+      // CC 15 for filter envelope decay
+      if (cc == 15) {
+        voices_[i].Env2().AddDecay((value / 127.0f) * 5.0f);
+      }
+    }
+  }
+
+  /**
+   * Queue a MIDI message for the next Process call, which splits the block
+   * so the message lands on the right sample. When the queue is full it's
+   * applied straight away
+   */
+  void QueueEvent(const Event &event) {
+    if (numEvents_ == SYNTH_MAX_EVENTS) {
+      handleEvent(event);
+      return;
+    }
+    // keep them in offset order, they mostly come in order anyway
+    size_t i = numEvents_++;
+    while (i > 0 && events_[i - 1].offset > event.offset) {
+      events_[i] = events_[i - 1];
+      i--;
+    }
+    events_[i] = event;
+  }
+
+  /**
+   * AUDIO
+   */
+
+  void Process(float *out1, float *out2, size_t size) {
+    // parameters only change here, never in the middle of a block
+    {
+      PROFILE_SCOPE(PROFILE_PARAMS);
+      if (paramBuffer_.Update()) {
+        applyParams(paramBuffer_.Front());
+      }
+      smoothers_.Process(size);
+      for (int n = 0; n < smoothers_.GetNumChanged(); n++) {
+        applySmoothed(smoothers_.GetChanged(n));
+      }
+      modulate(size);
+    }
+
+    memset(out1, 0, size * sizeof(float));
+    memset(out2, 0, size * sizeof(float));
+    // render up to each queued event, then apply it
+    size_t pos = 0;
+    for (size_t e = 0; e < numEvents_; e++) {
+      size_t offset = events_[e].offset < size ? events_[e].offset : size;
+      processVoices(out1 + pos, out2 + pos, offset - pos);
+      pos = offset;
+      handleEvent(events_[e]);
+    }
+    numEvents_ = 0;
+    processVoices(out1 + pos, out2 + pos, size - pos);
+  }
+
+  /**
+   * PARAMETERS
+   *
+   * set from the main loop, the audio callback gets them all at the start
+   * of the block after CommitParams. The slow maths (pow for the curve
+   * tables) happens here, not in the callback. The continuous ones glide
+   * to their new value over SYNTH_SMOOTH_TIME
+   */
+
+  // Hand the parameters set since the last call over to the audio callback
+  void CommitParams() {
+    if (!paramsChanged_) {
+      return;
+    }
+    paramBuffer_.Back() = params_;
+    paramBuffer_.Publish();
+    paramsChanged_ = false;
+  }
+
+  void SetTranspose(int t) {
+    params_.transpose = t;
+    paramsChanged_ = true;
+  }
+  int GetTranspose() { return params_.transpose; }
+
+  void SetGlideTime(float t) {
+    params_.glideTime = t;
+    paramsChanged_ = true;
+  }
+  float GetGlideTime() { return params_.glideTime; }
+
+  void SetDetune(float d) {
+    params_.detune = Oscillator::ClampDetune(d);
+    paramsChanged_ = true;
+  }
+  float GetDetune() { return params_.detune; }
+
+  void SetFilterFreq(float f) {
+    params_.filterFreq = f;
+    paramsChanged_ = true;
+  }
+  // in Hz
+  float GetFilterFreq() {
+    return StereoFilter::IndexToFreq(params_.filterFreq);
+  }
+
+  void SetFilterQ(float q) {
+    params_.filterQ = q;
+    paramsChanged_ = true;
+  }
+  float GetFilterQ() { return StereoFilter::IndexToQ(params_.filterQ); }
+
+  // amplitude envelope
+
+  void SetAttack(float a) {
+    params_.attack = Envelope::ClampTime(a);
+    paramsChanged_ = true;
+  }
+  float GetAttack() { return params_.attack; }
+
+  void SetDecay(float d) {
+    params_.decay = Envelope::ClampTime(d);
+    paramsChanged_ = true;
+  }
+  float GetDecay() { return params_.decay; }
+
+  void SetCurve(float c) {
+    params_.curve.Set(c);
+    paramsChanged_ = true;
+  }
+  float GetCurve() { return params_.curve.GetCurve(); }
+
+  // filter envelope
+
+  void SetFilterAttack(float a) {
+    params_.filterAttack = Envelope::ClampTime(a);
+    paramsChanged_ = true;
+  }
+  float GetFilterAttack() { return params_.filterAttack; }
+
+  void SetFilterDecay(float d) {
+    params_.filterDecay = Envelope::ClampTime(d);
+    paramsChanged_ = true;
+  }
+  float GetFilterDecay() { return params_.filterDecay; }
+
+  void SetFilterCurve(float c) {
+    params_.filterCurve.Set(c);
+    paramsChanged_ = true;
+  }
+  float GetFilterCurve() { return params_.filterCurve.GetCurve(); }
+
+  void SetFilterScale(float s) {
+    params_.filterScale = Envelope::ClampScale(s);
+    paramsChanged_ = true;
+  }
+  float GetFilterScale() { return params_.filterScale; }
+
+  // modulation, see Modulation.hpp
+
+  void SetLfoRate(int lfo, float hz) {
+    params_.lfoRate[lfo] = hz;
+    paramsChanged_ = true;
+  }
+  float GetLfoRate(int lfo) { return params_.lfoRate[lfo]; }
+
+  void SetLfoShape(int lfo, Lfo::Shape shape) {
+    params_.lfoShape[lfo] = shape;
+    paramsChanged_ = true;
+  }
+  Lfo::Shape GetLfoShape(int lfo) { return params_.lfoShape[lfo]; }
+
+  // One of the MOD_MAX_ROUTES slots, an amount of 0 turns it off
+  void SetModRoute(int slot, ModSource source, ModDest dest, float amount) {
+    params_.mod.SetRoute(slot, source, dest, amount);
+    paramsChanged_ = true;
+  }
+  const ModMatrix::Route &GetModRoute(int slot) {
+    return params_.mod.GetRoute(slot);
+  }
+
+  /**
+   * SETUP
+   *
+   * set on every voice right after Init, before the audio starts
+   */
+
+  void SetOscMode(Oscillator::Mode mode) {
+    for (size_t i = 0; i < numVoices_; i++) {
+      voices_[i].Osc().SetMode(mode);
+    }
+  }
+  Oscillator::Mode GetOscMode() { return voices_[0].Osc().GetMode(); }
+
+  // How often the envelopes are worked out, the voices start in
+  // CONTROL_RATE every ENVELOPE_CONTROL_INTERVAL samples
+  void SetEnvelopeMode(Envelope::RateMode mode,
+                       size_t interval = ENVELOPE_CONTROL_INTERVAL) {
+    for (size_t i = 0; i < numVoices_; i++) {
+      voices_[i].Env1().SetRateMode(mode, interval);
+      voices_[i].Env2().SetRateMode(mode, interval);
+    }
+  }
+
+  // 1, 2 or 4
+  void SetFilterOversampling(int factor) {
+    oversampling_ = factor >= 4 ? 4 : (factor >= 2 ? 2 : 1);
+    // a tier can stop doing anything
+    SetQuality(quality_);
+  }
+  int GetFilterOversampling() { return oversampling_; }
+
+  /**
+   * QUALITY
+   *
+   * audio side, eg from a Governor in the callback between Process calls,
+   * nothing here builds a table. The setup above is what full quality
+   * means, the lower tiers take away from it
+   *
+   * @param tier 0 is full quality, up to GetNumQualityTiers() - 1
+   */
+  void SetQuality(int tier) {
+    int last = GetNumQualityTiers() - 1;
+    quality_ = tier < 0 ? 0 : (tier > last ? last : tier);
+    applyQuality();
+  }
+  int GetQuality() { return quality_; }
+
+  // Tiers with the setup now, full quality and a tier for every
+  // QualityStep that saves something, eg for Governor::Init. Changes with
+  // SetFilterOversampling
+  int GetNumQualityTiers() {
+    int tiers = 1;
+    for (int step = 0; step < NUM_QUALITY_STEPS; step++) {
+      tiers += qualityStepChanges(step);
+    }
+    return tiers;
+  }
+
+private:
+  static constexpr size_t numVoices_ = SWARM_VOICES;
+
+  // the setup, SetQuality takes away from it
+  int oversampling_;
+  int quality_;
+  // voices new notes can have
+  size_t activeVoices_;
+
+  Voice voices_[numVoices_];
+  VoiceBuffers buffers_;
+  VoiceMode voiceMode_;
+  StealMode stealMode_;
+
+  // main loop side of the parameters
+  SynthParams params_;
+  bool paramsChanged_;
+  // from the main loop to the audio callback, the voice envelopes use the
+  // curve tables in Front
+  TripleBuffer<SynthParams> paramBuffer_;
+
+  // audio side copies, used by midi note on
+  int transpose_;
+  float glideTime_; // seconds
+  // for mono mode
+  bool noteHeld_;
+  // counts note ons, for the voice ages
+  uint32_t noteCount_;
+
+  // for the next Process call, in offset order
+  Event events_[SYNTH_MAX_EVENTS];
+  size_t numEvents_;
+
+  // the parameters that glide, numbers for smoothers_
+  enum Smoothed {
+    SMOOTH_FILTER_FREQ = 0,
+    SMOOTH_FILTER_Q,
+    SMOOTH_DETUNE,
+    SMOOTH_FILTER_SCALE,
+    // one per LFO
+    SMOOTH_LFO_RATE,
+    // one per mod route slot
+    SMOOTH_MOD_AMOUNT = SMOOTH_LFO_RATE + MOD_NUM_LFOS,
+    NUM_SMOOTHED = SMOOTH_MOD_AMOUNT + MOD_MAX_ROUTES,
+  };
+  SmootherBank<NUM_SMOOTHED> smoothers_;
+
+  // audio side modulation, the routes follow the ones in params with the
+  // amounts smoothed
+  Lfo lfos_[MOD_NUM_LFOS];
+  ModMatrix mod_;
+  // destinations that were modulated in the last block
+  uint32_t modMask_;
+
+  // whether a QualityStep saves anything with the setup now
+  bool qualityStepChanges(int step) {
+    switch (step) {
+    case QUALITY_LESS_OVERSAMPLING:
+      return oversampling_ > 1;
+    case QUALITY_HALF_VOICES:
+      return numVoices_ > 1;
+    default:
+      return false;
+    }
+  }
+
+  // the setup with what the quality tier takes away, only the voices that
+  // change are touched
+  void applyQuality() {
+    // the first quality_ steps that change something
+    bool taken[NUM_QUALITY_STEPS] = {};
+    for (int step = 0, left = quality_; step < NUM_QUALITY_STEPS && left > 0;
+         step++) {
+      if (qualityStepChanges(step)) {
+        taken[step] = true;
+        left--;
+      }
+    }
+    // the filters have the tables for every factor from Init
+    int oversampling = taken[QUALITY_LESS_OVERSAMPLING] ? oversampling_ / 2
+                                                        : oversampling_;
+    activeVoices_ =
+        taken[QUALITY_HALF_VOICES] ? numVoices_ / 2 : numVoices_;
+    for (size_t i = 0; i < numVoices_; i++) {
+      Voice &v = voices_[i];
+      if (v.Filt().GetOversampling() != oversampling) {
+        v.Filt().SetOversampling(oversampling);
+      }
+    }
+  }
+
+  // audio side from scratch, the smoothed parameters jump to where they
+  // are going
+  void startAudioSide(float sr) {
+    const SynthParams &p = paramBuffer_.Front();
+    modMask_ = 0;
+    mod_ = p.mod;
+    smoothers_.Init(sr, SYNTH_SMOOTH_TIME);
+    smoothers_.Reset(SMOOTH_FILTER_FREQ, p.filterFreq);
+    smoothers_.Reset(SMOOTH_FILTER_Q, p.filterQ);
+    smoothers_.Reset(SMOOTH_DETUNE, p.detune);
+    smoothers_.Reset(SMOOTH_FILTER_SCALE, p.filterScale);
+    for (int i = 0; i < MOD_NUM_LFOS; i++) {
+      smoothers_.Reset(SMOOTH_LFO_RATE + i, p.lfoRate[i]);
+    }
+    for (int i = 0; i < MOD_MAX_ROUTES; i++) {
+      smoothers_.Reset(SMOOTH_MOD_AMOUNT + i, p.mod.GetRoute(i).amount);
+    }
+    for (int i = 0; i < NUM_SMOOTHED; i++) {
+      applySmoothed(i);
+    }
+    applyParams(p);
+  }
+
+  // audio side, cheap setters only
+  void applyParams(const SynthParams &p) {
+    transpose_ = p.transpose;
+    glideTime_ = p.glideTime;
+    smoothers_.SetTarget(SMOOTH_FILTER_FREQ, p.filterFreq);
+    smoothers_.SetTarget(SMOOTH_FILTER_Q, p.filterQ);
+    smoothers_.SetTarget(SMOOTH_DETUNE, p.detune);
+    smoothers_.SetTarget(SMOOTH_FILTER_SCALE, p.filterScale);
+    for (int i = 0; i < MOD_NUM_LFOS; i++) {
+      smoothers_.SetTarget(SMOOTH_LFO_RATE + i, p.lfoRate[i]);
+      lfos_[i].SetShape(p.lfoShape[i]);
+    }
+    // a route's source and destination switch straight away, its amount
+    // glides like a knob
+    for (int i = 0; i < MOD_MAX_ROUTES; i++) {
+      const ModMatrix::Route &r = p.mod.GetRoute(i);
+      const ModMatrix::Route &now = mod_.GetRoute(i);
+      if (r.source != now.source || r.dest != now.dest) {
+        mod_.SetRoute(i, r.source, r.dest, now.amount);
+      }
+      smoothers_.SetTarget(SMOOTH_MOD_AMOUNT + i, r.amount);
+    }
+    for (size_t i = 0; i < numVoices_; i++) {
+      Voice &v = voices_[i];
+      v.Env1().SetAttack(p.attack);
+      v.Env1().SetDecay(p.decay);
+      v.Env1().SetCurveTable(&p.curve);
+      v.Env2().SetAttack(p.filterAttack);
+      v.Env2().SetDecay(p.filterDecay);
+      v.Env2().SetCurveTable(&p.filterCurve);
+    }
+  }
+
+  // audio side, one smoothed parameter to every voice, or to the LFOs and
+  // routes
+  void applySmoothed(int param) {
+    float value = smoothers_.Get(param);
+    if (param >= SMOOTH_MOD_AMOUNT) {
+      const ModMatrix::Route &r = mod_.GetRoute(param - SMOOTH_MOD_AMOUNT);
+      mod_.SetRoute(param - SMOOTH_MOD_AMOUNT, r.source, r.dest, value);
+      return;
+    }
+    if (param >= SMOOTH_LFO_RATE) {
+      lfos_[param - SMOOTH_LFO_RATE].SetRate(value);
+      return;
+    }
+    if (param == SMOOTH_DETUNE) {
+      // worked out once for all the voices
+      float ratios[SWARM_SAWS];
+      Oscillator::CalcDetuneRatios(value, ratios);
+      for (size_t i = 0; i < numVoices_; i++) {
+        voices_[i].Osc().SetDetuneRatios(value, ratios);
+      }
+      return;
+    }
+    for (size_t i = 0; i < numVoices_; i++) {
+      Voice &v = voices_[i];
+      switch (param) {
+      case SMOOTH_FILTER_FREQ:
+        v.Filt().SetFreq(value);
+        break;
+      case SMOOTH_FILTER_Q:
+        v.Filt().SetQ(value);
+        break;
+      case SMOOTH_FILTER_SCALE:
+        v.Env2().SetScale(value);
+        break;
+      }
+    }
+  }
+
+  // audio side, once per block: the LFOs move on and every voice gets its
+  // modulated parameters on top of the smoothed ones. Only the destinations
+  // something goes to are touched, and the ones that just lost their routes
+  // once more so they go back to the knob
+  void modulate(size_t size) {
+    float sources[MOD_NUM_SOURCES];
+    for (int i = 0; i < MOD_NUM_LFOS; i++) {
+      sources[MOD_SRC_LFO1 + i] = lfos_[i].Process(size);
+    }
+    uint32_t touched = mod_.GetDestMask() | modMask_;
+    modMask_ = mod_.GetDestMask();
+    if (touched == 0) {
+      return;
+    }
+    for (size_t i = 0; i < numVoices_; i++) {
+      Voice &v = voices_[i];
+      sources[MOD_SRC_ENV1] = v.GetLevel();
+      sources[MOD_SRC_ENV2] = v.Env2().GetOutput();
+      float dests[MOD_NUM_DESTS];
+      mod_.Process(sources, dests);
+      if (touched & (1u << MOD_DST_FILTER_FREQ)) {
+        // slides there across the block
+        v.Filt().SetFreq(smoothers_.Get(SMOOTH_FILTER_FREQ) +
+                         dests[MOD_DST_FILTER_FREQ]);
+      }
+      if (touched & (1u << MOD_DST_FILTER_Q)) {
+        v.Filt().SetQ(smoothers_.Get(SMOOTH_FILTER_Q) +
+                      dests[MOD_DST_FILTER_Q]);
+      }
+      if (touched & (1u << MOD_DST_DETUNE)) {
+        float detune = Oscillator::ClampDetune(smoothers_.Get(SMOOTH_DETUNE) +
+                                               dests[MOD_DST_DETUNE]);
+        float ratios[SWARM_SAWS];
+        Oscillator::CalcDetuneRatios(detune, ratios);
+        v.Osc().SetDetuneRatios(detune, ratios);
+      }
+      if (touched & (1u << MOD_DST_PAN_SPREAD)) {
+        v.Osc().SetPanSpread(1.0f + dests[MOD_DST_PAN_SPREAD]);
+      }
+      if (touched & (1u << MOD_DST_PITCH)) {
+        // ramps there across the block
+        v.Osc().SetPitchMod(dests[MOD_DST_PITCH], size);
+      }
+    }
+  }
+
+  void handleEvent(const Event &event) {
+    switch (event.type) {
+    case NOTE_ON:
+      NoteOn(event.data1, event.data2);
+      break;
+    case NOTE_OFF:
+      NoteOff(event.data1);
+      break;
+    case CC:
+      ControlChange(event.data1, event.data2);
+      break;
+    }
+  }
+
+  void processVoices(float *out1, float *out2, size_t size) {
+    if (size == 0) {
+      return;
+    }
+    // idle voices cost nothing
+    for (size_t i = 0; i < numVoices_; i++) {
+      if (voices_[i].IsActive()) {
+        voices_[i].Process(out1, out2, size, buffers_);
+      }
+    }
+  }
+
+  // voice for a new note: the one already playing that key, an idle one,
+  // or one stolen from another note
+  Voice &allocVoice(int key) {
+    for (size_t i = 0; i < numVoices_; i++) {
+      if (voices_[i].IsActive() && voices_[i].GetKey() == key) {
+        return voices_[i];
+      }
+    }
+    for (size_t i = 0; i < activeVoices_; i++) {
+      if (!voices_[i].IsActive()) {
+        return voices_[i];
+      }
+    }
+    // released voices go before held ones
+    size_t best = 0;
+    for (size_t i = 1; i < activeVoices_; i++) {
+      Voice &v = voices_[i];
+      Voice &b = voices_[best];
+      if (v.IsHeld() != b.IsHeld()) {
+        best = v.IsHeld() ? best : i;
+      } else if (stealMode_ == STEAL_OLDEST) {
+        best = v.GetAge() < b.GetAge() ? i : best;
+      } else {
+        best = v.GetLevel() < b.GetLevel() ? i : best;
+      }
+    }
+    return voices_[best];
+  }
+};
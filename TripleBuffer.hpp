@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+
+// Latest value of T from one thread to another without locks or waiting,
+// eg parameters from the main loop to the audio callback.
+// The writer fills Back and publishes it, the reader calls Update and reads
+// Front, which stays put until its next Update. The third copy is the one
+// in between, so neither side ever touches the other's copy
+template <typename T> class TripleBuffer {
+public:
+  TripleBuffer() : back_(0), front_(1), middle_(2) {}
+
+  // Writer side, the copy to fill, its old contents are stale
+  T &Back() { return slots_[back_]; }
+
+  // Writer side, hand Back over to the reader
+  void Publish() {
+    back_ = middle_.exchange(back_ | newBit_, std::memory_order_acq_rel) &
+            indexMask_;
+  }
+
+  // Reader side, true when Front changed to a newly published copy
+  bool Update() {
+    if (!(middle_.load(std::memory_order_relaxed) & newBit_)) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & indexMask_;
+    return true;
+  }
+
+  // Reader side
+  const T &Front() { return slots_[front_]; }
+
+private:
+  static constexpr int indexMask_ = 3;
+  static constexpr int newBit_ = 4; // set in middle_ when it's unread
+
+  T slots_[3];
+  int back_, front_;
+  std::atomic<int> middle_;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Envelope.hpp"
+#include "Filter.hpp"
+#include "Oscillator.hpp"
+#include "Profiler.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// longest chunk a voice processes in one go, bigger blocks get split
+#define VOICE_MAX_BLOCK 64
+
+// Work buffers shared by all the voices, only used during Process
+struct VoiceBuffers {
+  float env1[VOICE_MAX_BLOCK], env2[VOICE_MAX_BLOCK];
+  float out1[VOICE_MAX_BLOCK], out2[VOICE_MAX_BLOCK];
+  Float2 frames[VOICE_MAX_BLOCK];
+};
+
+// One swarm: oscillator, stereo filter, amplitude and filter envelopes
+// and its own pitch slide
+class Voice {
+public:
+  Voice() {}
+  ~Voice() {}
+
+  void Init(float sr) {
+    sr_ = sr;
+    osc_.Init(sr_);
+    filter_.Init(sr_);
+    env1_.Init(sr_);
+    env1_.SetCurve(2.5f);
+    env2_.Init(sr_);
+    env2_.SetCurve(2.0f);
+    // both only drive the amplitude and the filter, a value every few
+    // samples is plenty
+    env1_.SetRateMode(Envelope::CONTROL_RATE);
+    env2_.SetRateMode(Envelope::CONTROL_RATE);
+    targetNote_ = 0.0f;
+    key_ = -1;
+    held_ = false;
+    age_ = 0;
+    tailLength_ = static_cast<uint32_t>(0.1f * sr_);
+    tail_ = 0;
+  }
+
+  // Start a note, no slide
+  void Trigger(float note) {
+    targetNote_ = note;
+    osc_.SetPitch(note);
+    env1_.Trigger();
+    env2_.Trigger();
+    tail_ = tailLength_;
+  }
+
+  // Slide to a note without retriggering, over glideTime seconds
+  void Glide(float note, float glideTime) {
+    targetNote_ = note;
+    // the oscillator moves the pitch every sample, linear in notes
+    osc_.GlideTo(note, glideTime);
+  }
+
+  // Add the next size samples to out1 and out2
+  void Process(float *out1, float *out2, size_t size, VoiceBuffers &buf) {
+    // let the filter ring out after the envelope before going idle
+    if (!env1_.IsActive()) {
+      tail_ = tail_ > size ? tail_ - size : 0;
+    }
+
+    while (size > 0) {
+      size_t n = size < VOICE_MAX_BLOCK ? size : VOICE_MAX_BLOCK;
+      {
+        PROFILE_SCOPE(PROFILE_ENV);
+        env1_.ProcessBlock(buf.env1, n);
+        env2_.ProcessBlock(buf.env2, n);
+      }
+      // half volume into the filter
+      for (size_t i = 0; i < n; i++) {
+        buf.env1[i] *= 0.5f;
+      }
+      {
+        PROFILE_SCOPE(PROFILE_OSC);
+        osc_.ProcessBlock(buf.out1, buf.out2, buf.env1, n);
+      }
+      // both channels go through the filter together
+      for (size_t i = 0; i < n; i++) {
+        buf.frames[i] = Float2(buf.out1[i], buf.out2[i]);
+      }
+      {
+        PROFILE_SCOPE(PROFILE_FILTER);
+        filter_.ProcessBlock(buf.frames, buf.env2, n);
+      }
+      for (size_t i = 0; i < n; i++) {
+        float frame[2];
+        buf.frames[i].Store(frame);
+        out1[i] += frame[0];
+        out2[i] += frame[1];
+      }
+      out1 += n;
+      out2 += n;
+      size -= n;
+    }
+  }
+
+  // Still making sound, the amplitude envelope or the filter tail after it
+  // haven't finished, idle voices don't need processing
+  bool IsActive() { return env1_.IsActive() || tail_ > 0; }
+  // Amplitude envelope level, for stealing the quietest voice
+  float GetLevel() { return env1_.GetOutput(); }
+  float GetNote() { return targetNote_; }
+
+  // set by the voice pool
+  // MIDI key before transpose, note offs match on this
+  void SetKey(int key) { key_ = key; }
+  int GetKey() { return key_; }
+  void SetHeld(bool held) { held_ = held; }
+  bool IsHeld() { return held_; }
+  // note on count when this voice was started
+  void SetAge(uint32_t age) { age_ = age; }
+  uint32_t GetAge() { return age_; }
+
+  // getters for passthrough
+  Oscillator &Osc() { return osc_; }
+  StereoFilter &Filt() { return filter_; }
+  Envelope &Env1() { return env1_; }
+  Envelope &Env2() { return env2_; }
+
+private:
+  float sr_;
+
+  Oscillator osc_;
+  StereoFilter filter_;
+  Envelope env1_; // amplitude
+  Envelope env2_; // filter
+
+  int key_;
+  bool held_;
+  uint32_t age_;
+  // samples left before the voice goes idle once the envelope is off
+  uint32_t tail_, tailLength_;
+
+  // where the pitch slide ends, the oscillator keeps the current pitch
+  float targetNote_;
+};
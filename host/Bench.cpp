@@ -0,0 +1,971 @@
+// Benchmarks for the DSP code, runs on the computer
+//
+// usage: bench [options] [section...], runs every section without arguments
+//   -o <file>     write the hotpath results to file
+//   -c <file>     compare the hotpath results against file, fails when one
+//                 got slower
+//   -p <percent>  how much slower counts as slower (default 10)
+
+#include "../AudioProfiles.hpp"
+#include "../Envelope.hpp"
+#include "../FastMath.hpp"
+#include "../Filter.hpp"
+#include "../Governor.hpp"
+#include "../Oscillator.hpp"
+#include "../Profiler.hpp"
+#include "../Synth.hpp"
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const float samplerate = 96000.0f;
+static const size_t blocksize = 16;
+static const size_t benchSamples = 96000 * 10;
+
+static double now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * STEREO FILTER
+ *
+ * two mono filters against one StereoFilter with the same settings
+ */
+
+static void benchStereoFilter() {
+  std::vector<float> left(benchSamples), right(benchSamples);
+  std::vector<float> env(benchSamples, 0.3f);
+  float phaseL = 0.0f, phaseR = 0.5f;
+  for (size_t i = 0; i < benchSamples; i++) {
+    left[i] = (2.0f * phaseL - 1.0f) * 0.25f;
+    right[i] = (2.0f * phaseR - 1.0f) * 0.25f;
+    phaseL += 55.0f / samplerate;
+    phaseL -= phaseL > 1.0f ? 1.0f : 0.0f;
+    phaseR += 55.3f / samplerate;
+    phaseR -= phaseR > 1.0f ? 1.0f : 0.0f;
+  }
+
+  printf("stereo filter, %g Hz, block %zu\n", samplerate, blocksize);
+  printf("%-12s %16s %12s\n", "filter", "ns/stereo pair", "max error");
+
+  Filter filterL, filterR;
+  filterL.Init(samplerate);
+  filterR.Init(samplerate);
+  std::vector<float> refL = left, refR = right;
+  double start = now();
+  for (size_t i = 0; i < benchSamples; i += blocksize) {
+    filterL.ProcessBlock(&refL[i], &env[i], blocksize);
+    filterR.ProcessBlock(&refR[i], &env[i], blocksize);
+  }
+  double ns = (now() - start) * 1e9 / benchSamples;
+  printf("%-12s %16.2f %12s\n", "2x Filter", ns, "-");
+
+  StereoFilter stereo;
+  stereo.Init(samplerate);
+  std::vector<Float2> frames(benchSamples);
+  for (size_t i = 0; i < benchSamples; i++) {
+    frames[i] = Float2(left[i], right[i]);
+  }
+  start = now();
+  for (size_t i = 0; i < benchSamples; i += blocksize) {
+    stereo.ProcessBlock(&frames[i], &env[i], blocksize);
+  }
+  ns = (now() - start) * 1e9 / benchSamples;
+  double maxError = 0.0;
+  for (size_t i = 0; i < benchSamples; i++) {
+    float frame[2];
+    frames[i].Store(frame);
+    maxError = fmax(maxError, fabs(frame[0] - refL[i]));
+    maxError = fmax(maxError, fabs(frame[1] - refR[i]));
+  }
+  printf("%-12s %16.2f %12.6f\n", "StereoFilter", ns, maxError);
+  printf("\n");
+}
+
+/**
+ * OVERSAMPLING
+ *
+ * a loud sine into the filter with the cutoff and Q up, the shaper in the
+ * feedback loop makes harmonics and the ones past nyquist fold back.
+ * Aliasing is the power of the folded harmonics that land below 20kHz,
+ * relative to the whole output
+ */
+
+// power of bin k of x (length n), Goertzel
+static double binPower(const std::vector<float> &x, size_t k) {
+  double w = 2.0 * M_PI * k / x.size();
+  double c = 2.0 * cos(w), s1 = 0.0, s2 = 0.0;
+  for (float v : x) {
+    double s0 = v + c * s1 - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+  return s1 * s1 + s2 * s2 - c * s1 * s2;
+}
+
+static void benchOversampling() {
+  // whole Hz so every harmonic lands on a bin of a one second DFT
+  const size_t freq = 1777;
+  const float rates[] = {48000.0f, 96000.0f};
+  const int factors[] = {1, 2, 4};
+
+  printf("oversampling, %zu Hz sine, freq index 1, Q index 0.9, block %zu\n",
+         freq, blocksize);
+  printf("%-8s %-8s %16s %12s\n", "rate", "factor", "ns/stereo pair",
+         "aliasing dB");
+
+  for (float sr : rates) {
+    size_t n = size_t(sr);
+    std::vector<float> env(2 * n, 0.0f);
+    std::vector<Float2> frames(2 * n);
+    for (int factor : factors) {
+      for (size_t i = 0; i < 2 * n; i++) {
+        float x = 2.0f * sinf(2.0f * float(M_PI) * freq * (i % n) / sr);
+        frames[i] = Float2(x, x);
+      }
+      StereoFilter filter;
+      filter.Init(sr);
+      filter.SetOversampling(factor);
+      filter.SetFreq(1.0f);
+      filter.SetQ(0.9f);
+      double start = now();
+      for (size_t i = 0; i < 2 * n; i += blocksize) {
+        filter.ProcessBlock(&frames[i], &env[i], blocksize);
+      }
+      double ns = (now() - start) * 1e9 / (2 * n);
+
+      // second half, after the filter has settled
+      std::vector<float> out(n);
+      double total = 0.0;
+      for (size_t i = 0; i < n; i++) {
+        float frame[2];
+        frames[n + i].Store(frame);
+        out[i] = frame[0];
+        total += double(out[i]) * out[i];
+      }
+      double alias = 0.0;
+      for (size_t h = 2; h * freq < 4 * n; h++) {
+        size_t bin = (h * freq) % n;
+        bin = bin > n / 2 ? n - bin : bin;
+        // skip the ones that fold onto a harmonic
+        if (bin % freq != 0 && bin < 20000) {
+          alias += 2.0 * binPower(out, bin) / n;
+        }
+      }
+      printf("%-8g %-8d %16.2f %12.1f\n", sr, factor, ns,
+             10.0 * log10(alias / total));
+    }
+  }
+  printf("\n");
+}
+
+/**
+ * OSCILLATOR
+ *
+ * polyBLEP against the wavetables. Aliasing is everything between 20Hz and
+ * 20kHz that isn't near one of the saw harmonics, from a windowed FFT of
+ * the left output
+ */
+
+// in place radix 2 FFT, size is a power of 2
+static void fft(std::vector<std::complex<double>> &x) {
+  size_t n = x.size();
+  for (size_t i = 1, j = 0; i < n; i++) {
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      std::swap(x[i], x[j]);
+    }
+  }
+  for (size_t len = 2; len <= n; len <<= 1) {
+    std::complex<double> w = std::polar(1.0, -2.0 * M_PI / len);
+    for (size_t i = 0; i < n; i += len) {
+      std::complex<double> wk = 1.0;
+      for (size_t k = 0; k < len / 2; k++) {
+        std::complex<double> a = x[i + k], b = x[i + k + len / 2] * wk;
+        x[i + k] = a + b;
+        x[i + k + len / 2] = a - b;
+        wk *= w;
+      }
+    }
+  }
+}
+
+static double oscAliasing(Oscillator &osc, const std::vector<float> &out) {
+  size_t n = out.size();
+  // Blackman-Harris, sidelobes are below -90dB
+  std::vector<std::complex<double>> x(n);
+  for (size_t i = 0; i < n; i++) {
+    double p = 2.0 * M_PI * i / n;
+    double w = 0.35875 - 0.48829 * cos(p) + 0.14128 * cos(2 * p) -
+               0.01168 * cos(3 * p);
+    x[i] = out[i] * w;
+  }
+  fft(x);
+
+  // the window spreads every harmonic over a few bins either side
+  const int spread = 6;
+  double binHz = samplerate / n;
+  std::vector<bool> harmonic(n / 2, false);
+  for (int saw = 0; saw < osc.GetNumSaws(); saw++) {
+    double f = osc.GetFreq(saw);
+    for (double h = f; h < samplerate / 2; h += f) {
+      int bin = int(h / binHz + 0.5);
+      for (int b = bin - spread; b <= bin + spread; b++) {
+        if (b >= 0 && b < int(n / 2)) {
+          harmonic[b] = true;
+        }
+      }
+    }
+  }
+  double total = 0.0, alias = 0.0;
+  for (size_t b = 1; b < n / 2; b++) {
+    double power = std::norm(x[b]);
+    total += power;
+    double hz = b * binHz;
+    if (!harmonic[b] && hz > 20.0 && hz < 20000.0) {
+      alias += power;
+    }
+  }
+  return 10.0 * log10(alias / total);
+}
+
+static void benchOscillator() {
+  const int notes[] = {33, 57, 81, 93, 105};
+  const Oscillator::Mode modes[] = {Oscillator::POLYBLEP,
+                                    Oscillator::WAVETABLE};
+  const char *modeNames[] = {"polyBLEP", "wavetable"};
+  // power of 2 for the FFT
+  const size_t n = 1 << 18;
+
+  printf("oscillator, %g Hz, block %zu, detune 0.5\n", samplerate, blocksize);
+  printf("%-6s %-10s %10s %12s\n", "note", "mode", "ns/sample",
+         "aliasing dB");
+
+  std::vector<float> amp(blocksize, 1.0f), out1(n), out2(n);
+  for (int note : notes) {
+    for (int m = 0; m < 2; m++) {
+      Oscillator osc;
+      // fastest of 5, one run is a few ms and the machine is noisy
+      double ns = 0.0;
+      for (int r = 0; r < 5; r++) {
+        osc.Init(samplerate);
+        osc.SetMode(modes[m]);
+        osc.SetDetune(0.5f);
+        osc.SetNote(note);
+        double start = now();
+        for (size_t i = 0; i < n; i += blocksize) {
+          osc.ProcessBlock(&out1[i], &out2[i], &amp[0], blocksize);
+        }
+        double runNs = (now() - start) * 1e9 / n;
+        ns = r == 0 || runNs < ns ? runNs : ns;
+      }
+      printf("%-6d %-10s %10.2f %12.1f\n", note, modeNames[m], ns,
+             oscAliasing(osc, out1));
+    }
+  }
+  printf("\n");
+}
+
+/**
+ * SAW COUNT
+ *
+ * cost of the polyBLEP oscillator for different saw counts
+ */
+
+template <int N> static void runSaws() {
+  std::vector<float> amp(blocksize, 1.0f), out1(benchSamples),
+      out2(benchSamples);
+  OscillatorT<N> osc;
+  osc.Init(samplerate);
+  osc.SetNote(45);
+  double start = now();
+  for (size_t i = 0; i < benchSamples; i += blocksize) {
+    osc.ProcessBlock(&out1[i], &out2[i], &amp[0], blocksize);
+  }
+  double ns = (now() - start) * 1e9 / benchSamples;
+  printf("%-6d %10.2f %10.2f\n", N, ns, ns / N);
+}
+
+static void benchSaws() {
+  printf("saw count, %g Hz, block %zu\n", samplerate, blocksize);
+  printf("%-6s %10s %10s\n", "saws", "ns/sample", "ns/saw");
+  runSaws<1>();
+  runSaws<3>();
+  runSaws<5>();
+  runSaws<7>();
+  runSaws<9>();
+  runSaws<16>();
+  printf("\n");
+}
+
+/**
+ * AUDIO PROFILES
+ *
+ * one synth switched through the profiles with Synth::SetSampleRate like
+ * the Field does, a held note for a second of audio in each. The load is
+ * the time per block against the block period, so the headroom is what
+ * this computer would have left, the Field has a lot less
+ */
+
+static void benchProfiles() {
+  printf("audio profiles, one voice, a held note\n");
+  printf("%-8s %8s %10s %10s %10s %10s\n", "profile", "filter", "latency us",
+         "ns/block", "load %", "headroom %");
+  static Synth synth;
+  synth.Init(samplerate);
+  synth.SetDecay(5.0f);
+  synth.SetFilterQ(0.9f);
+  synth.CommitParams();
+  for (int p = 0; p < AUDIO_NUM_PROFILES; p++) {
+    const AudioProfileConfig &config = GetAudioProfileConfig(p);
+    synth.SetSampleRate(config.sampleRate);
+    synth.SetFilterOversampling(config.filterOversampling);
+    size_t size = static_cast<size_t>(config.sampleRate);
+    std::vector<float> out1(size), out2(size);
+    synth.NoteOn(36, 100);
+    double start = now();
+    for (size_t i = 0; i + config.blockSize <= size; i += config.blockSize) {
+      synth.Process(&out1[i], &out2[i], config.blockSize);
+    }
+    double ns = (now() - start) * 1e9 / (size / config.blockSize);
+    double period = config.blockSize / config.sampleRate * 1e9;
+    printf("%-8s %7dx %10.0f %10.0f %10.2f %10.2f\n", config.name,
+           config.filterOversampling, GetAudioLatency(period) / 1000.0, ns, 100.0 * ns / period,
+           100.0 * (1.0 - ns / period));
+    synth.NoteOff(36);
+  }
+  printf("\n");
+}
+
+/**
+ * HOT PATH
+ *
+ * ns and cycles per sample of what the audio callback runs, each piece on
+ * its own and then the whole synth, over a sweep of settings. Cycles are
+ * from Profiler::Now, TSC ticks on x86.
+ * The results can be written out (-o) and checked against a baseline
+ * written that way (-c), so a change that makes the hot path slower fails
+ * loudly. The baseline is only good for the machine that wrote it, make
+ * bench-check writes one the first time on a machine
+ */
+
+struct HotResult {
+  std::string name;
+  double ns, cycles; // per sample
+};
+static std::vector<HotResult> hotResults;
+
+// times of the fastest of a few runs, the slow ones are the machine busy
+// with something else. The cheap ones run more often so every result is
+// from at least hotMinTime seconds
+static const int hotRepeats = 5;
+static const double hotMinTime = 0.1;
+static const size_t hotSamples = 96000;
+// build/bench-scalar is built without SIMD or auto-vectorizing, about what
+// the Cortex-M7 gets, its results are named apart so they can't be compared
+// with the SIMD ones
+#if defined(SIMD_NONE)
+static const char *hotPrefix = "scalar/";
+#else
+static const char *hotPrefix = "";
+#endif
+
+template <typename F>
+static void measure(const std::string &shortName, F run) {
+  std::string name = hotPrefix + shortName;
+  // once to warm up the caches
+  run();
+  double bestNs = 0.0, bestCycles = 0.0, total = 0.0;
+  for (int r = 0; r < hotRepeats || total < hotMinTime; r++) {
+    double start = now();
+    uint32_t startTicks = Profiler::Now();
+    run();
+    uint32_t ticks = Profiler::Now() - startTicks;
+    double elapsed = now() - start;
+    total += elapsed;
+    double ns = elapsed * 1e9 / hotSamples;
+    if (r == 0 || ns < bestNs) {
+      bestNs = ns;
+      bestCycles = double(ticks) / hotSamples;
+    }
+  }
+  printf("%-36s %10.2f %12.2f\n", name.c_str(), bestNs, bestCycles);
+  // a second run keeps the fastest
+  for (HotResult &r : hotResults) {
+    if (r.name == name) {
+      if (bestNs < r.ns) {
+        r.ns = bestNs;
+        r.cycles = bestCycles;
+      }
+      return;
+    }
+  }
+  hotResults.push_back({name, bestNs, bestCycles});
+}
+
+static void benchHotPath() {
+  printf("hot path, %g Hz, block %zu, fastest of at least %d%s\n",
+         samplerate, blocksize, hotRepeats,
+         hotPrefix[0] ? ", no SIMD" : "");
+  printf("%-36s %10s %12s\n", "name", "ns/sample", "cycles/sample");
+
+  std::vector<float> out1(hotSamples), out2(hotSamples);
+  std::vector<float> amp(hotSamples, 1.0f);
+  char name[64];
+
+  // oscillator, both modes across the keyboard and the detune range
+  const char *modeNames[] = {"blep", "table"};
+  const Oscillator::Mode modes[] = {Oscillator::POLYBLEP,
+                                    Oscillator::WAVETABLE};
+  for (int m = 0; m < 2; m++) {
+    for (int note : {33, 69, 105}) {
+      for (float detune : {0.1f, 1.0f}) {
+        Oscillator osc;
+        osc.Init(samplerate);
+        osc.SetMode(modes[m]);
+        osc.SetDetune(detune);
+        osc.SetNote(note);
+        snprintf(name, sizeof(name), "osc/%s/note%d/detune%g", modeNames[m],
+                 note, detune);
+        measure(name, [&] {
+          for (size_t i = 0; i < hotSamples; i += blocksize) {
+            osc.ProcessBlock(&out1[i], &out2[i], &amp[i], blocksize);
+          }
+        });
+      }
+    }
+    // an octave up, gliding the whole run
+    Oscillator osc;
+    osc.Init(samplerate);
+    osc.SetMode(modes[m]);
+    snprintf(name, sizeof(name), "osc/%s/glide", modeNames[m]);
+    measure(name, [&] {
+      osc.SetNote(57);
+      osc.GlideTo(69.0f, hotSamples / samplerate);
+      for (size_t i = 0; i < hotSamples; i += blocksize) {
+        osc.ProcessBlock(&out1[i], &out2[i], &amp[i], blocksize);
+      }
+    });
+  }
+
+  // the stereo filter the voices use, with a moving envelope so the
+  // coefficients change every sample
+  std::vector<float> env(hotSamples);
+  std::vector<Float2> frames(hotSamples);
+  for (size_t i = 0; i < hotSamples; i++) {
+    env[i] = 0.5f * float(i % 4800) / 4800.0f;
+    float x = float(i % 218) / 109.0f - 1.0f;
+    frames[i] = Float2(x, -x);
+  }
+  for (int factor : {1, 2}) {
+    for (float freq : {0.2f, 0.8f}) {
+      for (float q : {0.0f, 0.5f, 0.95f}) {
+        StereoFilter filter;
+        filter.Init(samplerate);
+        filter.SetOversampling(factor);
+        filter.SetFreq(freq);
+        filter.SetQ(q);
+        std::vector<Float2> buf = frames;
+        snprintf(name, sizeof(name), "filter/x%d/freq%g/q%g", factor, freq,
+                 q);
+        measure(name, [&] {
+          for (size_t i = 0; i < hotSamples; i += blocksize) {
+            filter.ProcessBlock(&buf[i], &env[i], blocksize);
+          }
+        });
+      }
+    }
+  }
+
+  // the coefficient lookup on its own, one per sample across the table
+  {
+    Filter filter;
+    filter.Init(samplerate);
+    for (float q : {0.0f, 0.95f}) {
+      float sum = 0.0f;
+      snprintf(name, sizeof(name), "coeffs/q%g", q);
+      measure(name, [&] {
+        for (size_t i = 0; i < hotSamples; i++) {
+          FilterCoeffs c = filter.GetInterpolatedCoeffs(env[i] * 2.0f, q);
+          sum += c.b0 + c.k + c.g;
+        }
+      });
+      // keeps the lookups from being optimized away
+      out1[0] = sum;
+    }
+  }
+
+  // envelope, retriggered every 100ms, short enough to go through all the
+  // segments. Every sample, then every ENVELOPE_CONTROL_INTERVAL samples
+  // like the voices
+  for (int control = 0; control < 2; control++) {
+    for (float curve : {1.0f, 2.5f, 4.0f}) {
+      Envelope envelope;
+      envelope.Init(samplerate);
+      envelope.SetAttack(0.01f);
+      envelope.SetDecay(0.05f);
+      envelope.SetCurve(curve);
+      if (control) {
+        envelope.SetRateMode(Envelope::CONTROL_RATE);
+        snprintf(name, sizeof(name), "env/control/curve%g", curve);
+      } else {
+        snprintf(name, sizeof(name), "env/curve%g", curve);
+      }
+      measure(name, [&] {
+        for (size_t i = 0; i < hotSamples; i += blocksize) {
+          if (i % 9600 == 0) {
+            envelope.Trigger();
+          }
+          envelope.ProcessBlock(&out1[i], blocksize);
+        }
+      });
+    }
+  }
+
+  // the whole voice chain as the audio callback runs it, one held note
+  for (int note : {36, 72}) {
+    for (float q : {0.2f, 0.9f}) {
+      static Synth synth;
+      synth.Init(samplerate);
+      synth.SetFilterQ(q);
+      synth.SetDecay(5.0f);
+      synth.CommitParams();
+      snprintf(name, sizeof(name), "synth/note%d/q%g", note, q);
+      measure(name, [&] {
+        // every run from a fresh note, the decay outlasts one run
+        synth.NoteOff(note);
+        synth.NoteOn(note, 100);
+        for (size_t i = 0; i < hotSamples; i += blocksize) {
+          synth.Process(&out1[i], &out2[i], blocksize);
+        }
+      });
+    }
+  }
+
+  // the same with modulation routes, from 5 on every source and destination
+  // is used. The routes are worked out once per block, what they add to
+  // synth/note36/q0.2 is mostly the pitch ramp every sample, going from 5
+  // to 8 routes should cost next to nothing
+  for (int routes : {2, 5, MOD_MAX_ROUTES}) {
+    static Synth synth;
+    synth.Init(samplerate);
+    synth.SetDecay(5.0f);
+    for (int r = 0; r < routes; r++) {
+      synth.SetModRoute(r, ModSource(r % MOD_NUM_SOURCES),
+                        ModDest(r % MOD_NUM_DESTS), 0.1f);
+    }
+    synth.CommitParams();
+    snprintf(name, sizeof(name), "synth/mod/routes%d", routes);
+    measure(name, [&] {
+      synth.NoteOff(36);
+      synth.NoteOn(36, 100);
+      for (size_t i = 0; i < hotSamples; i += blocksize) {
+        synth.Process(&out1[i], &out2[i], blocksize);
+      }
+    });
+  }
+  printf("\n");
+}
+
+// Tab separated name, ns and cycles, one line per result
+static bool writeHotResults(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "can't write %s\n", path);
+    return false;
+  }
+  // timings only mean something on the machine that made them
+  fprintf(f, "# hotpath results, %g Hz, block %zu, only good for the "
+             "machine that wrote them\n",
+          samplerate, blocksize);
+  fprintf(f, "# name\tns/sample\tcycles/sample\n");
+  for (const HotResult &r : hotResults) {
+    fprintf(f, "%s\t%.3f\t%.3f\n", r.name.c_str(), r.ns, r.cycles);
+  }
+  fclose(f);
+  return true;
+}
+
+// Every result against the baseline, false when one is slower by more than
+// tolerance (a fraction) or the baseline can't be read
+static bool checkHotResults(const char *path, double tolerance) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "can't read baseline %s\n", path);
+    return false;
+  }
+  std::vector<HotResult> baseline;
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    char name[128];
+    double ns, cycles;
+    if (line[0] != '#' &&
+        sscanf(line, "%127s %lf %lf", name, &ns, &cycles) == 3) {
+      baseline.push_back({name, ns, cycles});
+    }
+  }
+  fclose(f);
+
+  printf("against %s, %.0f%% tolerance\n", path, tolerance * 100.0);
+  int slower = 0;
+  for (const HotResult &r : hotResults) {
+    const HotResult *base = nullptr;
+    for (const HotResult &b : baseline) {
+      base = b.name == r.name ? &b : base;
+    }
+    if (!base) {
+      printf("%-36s not in the baseline\n", r.name.c_str());
+      continue;
+    }
+    double change = r.ns / base->ns - 1.0;
+    bool bad = change > tolerance;
+    slower += bad;
+    printf("%-36s %10.2f %10.2f %+7.1f%%%s\n", r.name.c_str(), base->ns, r.ns,
+           change * 100.0, bad ? "  SLOWER" : "");
+  }
+  if (slower > 0) {
+    printf("\nFAILED: %d of %zu got slower than %s\n", slower,
+           hotResults.size(), path);
+    return false;
+  }
+  printf("\nno regressions\n");
+  return true;
+}
+
+/**
+ * FAST MATH
+ *
+ * every FastMath.hpp function and tier against libm, the largest error
+ * over its range and ns per call for both. The error bounds are the ones
+ * worked out in FastMath.hpp, one over its bound fails the benchmark
+ */
+
+static bool failed = false;
+
+// ns per call of f over xs (and ys), the sum keeps it from being
+// optimized away
+template <typename F>
+static double timeMath(const std::vector<float> &xs,
+                       const std::vector<float> &ys, F f) {
+  volatile float sink = 0.0f;
+  double best = 0.0;
+  for (int r = 0; r < 5; r++) {
+    float sum = 0.0f;
+    double start = now();
+    for (size_t i = 0; i < xs.size(); i++) {
+      sum += f(xs[i], ys[i]);
+    }
+    double ns = (now() - start) * 1e9 / xs.size();
+    best = r == 0 || ns < best ? ns : best;
+    sink = sink + sum;
+  }
+  return best;
+}
+
+/**
+ * One function and tier against libm
+ *
+ * @param relative Relative error instead of absolute
+ * @param bound Largest error allowed
+ */
+template <typename Fast, typename Ref>
+static void checkMath(const char *name, const char *tier,
+                      const std::vector<float> &xs,
+                      const std::vector<float> &ys, bool relative,
+                      double bound, Fast fast, Ref ref) {
+  double maxError = 0.0;
+  for (size_t i = 0; i < xs.size(); i++) {
+    double r = ref(double(xs[i]), double(ys[i]));
+    double e = fabs(double(fast(xs[i], ys[i])) - r);
+    e = relative ? e / fabs(r) : e;
+    maxError = e > maxError ? e : maxError;
+  }
+  double nsFast = timeMath(xs, ys, fast);
+  double nsRef = timeMath(xs, ys, [&](float x, float y) {
+    return float(ref(double(x), double(y)));
+  });
+  bool over = maxError > bound;
+  failed |= over;
+  printf("%-6s %-7s %-4s %12.3g %12.3g %9.2f %9.2f%s\n", name, tier,
+         relative ? "rel" : "abs", maxError, bound, nsFast, nsRef,
+         over ? "  OVER BOUND" : "");
+}
+
+static void benchFastMath() {
+  const size_t n = 1 << 16;
+  std::vector<float> wide(n), positive(n), unit(n), curve(n), angle(n),
+      zero(n, 0.0f);
+  for (size_t i = 0; i < n; i++) {
+    float t = (i + 0.5f) / n;
+    wide[i] = -20.0f + 40.0f * t;
+    positive[i] = 1e-6f + 1000.0f * t * t * t;
+    unit[i] = t;
+    curve[i] = 1.0f + 3.0f * float((i * 7919) % n) / n;
+    angle[i] = -50.0f + 100.0f * t;
+  }
+
+  printf("fast math against libm (double), %zu points\n", n);
+  printf("%-6s %-7s %-4s %12s %12s %9s %9s\n", "func", "tier", "err",
+         "max error", "bound", "ns fast", "ns libm");
+
+  const char *tiers[] = {"low", "medium", "high"};
+  const double exp2Bounds[] = {1.5e-4, 5.8e-6, 7.8e-7};
+  const double log2Bounds[] = {1.6e-3, 3.2e-5, 3.4e-6};
+  const double powBounds[] = {4.5e-3, 8.7e-5, 4.9e-6};
+  const double tanhBounds[] = {7.6e-5, 3.1e-6, 6.3e-7};
+  const double sinBounds[] = {9e-3, 1.5e-4, 8.8e-6};
+
+  auto exp2Ref = [](double x, double) { return exp2(x); };
+  checkMath("exp2", tiers[0], wide, zero, true, exp2Bounds[0],
+            [](float x, float) { return FastExp2<FAST_LOW>(x); }, exp2Ref);
+  checkMath("exp2", tiers[1], wide, zero, true, exp2Bounds[1],
+            [](float x, float) { return FastExp2<FAST_MEDIUM>(x); }, exp2Ref);
+  checkMath("exp2", tiers[2], wide, zero, true, exp2Bounds[2],
+            [](float x, float) { return FastExp2<FAST_HIGH>(x); }, exp2Ref);
+
+  auto log2Ref = [](double x, double) { return log2(x); };
+  checkMath("log2", tiers[0], positive, zero, false, log2Bounds[0],
+            [](float x, float) { return FastLog2<FAST_LOW>(x); }, log2Ref);
+  checkMath("log2", tiers[1], positive, zero, false, log2Bounds[1],
+            [](float x, float) { return FastLog2<FAST_MEDIUM>(x); }, log2Ref);
+  checkMath("log2", tiers[2], positive, zero, false, log2Bounds[2],
+            [](float x, float) { return FastLog2<FAST_HIGH>(x); }, log2Ref);
+
+  // the envelope curves, x^1 to x^4 for x from 0 to 1
+  auto powRef = [](double x, double y) { return pow(x, y); };
+  checkMath("pow", tiers[0], unit, curve, false, powBounds[0],
+            [](float x, float y) { return FastPow<FAST_LOW>(x, y); }, powRef);
+  checkMath(
+      "pow", tiers[1], unit, curve, false, powBounds[1],
+      [](float x, float y) { return FastPow<FAST_MEDIUM>(x, y); }, powRef);
+  checkMath("pow", tiers[2], unit, curve, false, powBounds[2],
+            [](float x, float y) { return FastPow<FAST_HIGH>(x, y); }, powRef);
+
+  auto tanhRef = [](double x, double) { return tanh(x); };
+  checkMath("tanh", tiers[0], wide, zero, false, tanhBounds[0],
+            [](float x, float) { return FastTanh<FAST_LOW>(x); }, tanhRef);
+  checkMath("tanh", tiers[1], wide, zero, false, tanhBounds[1],
+            [](float x, float) { return FastTanh<FAST_MEDIUM>(x); }, tanhRef);
+  checkMath("tanh", tiers[2], wide, zero, false, tanhBounds[2],
+            [](float x, float) { return FastTanh<FAST_HIGH>(x); }, tanhRef);
+
+  auto sinRef = [](double x, double) { return sin(x); };
+  checkMath("sin", tiers[0], angle, zero, false, sinBounds[0],
+            [](float x, float) { return FastSin<FAST_LOW>(x); }, sinRef);
+  checkMath("sin", tiers[1], angle, zero, false, sinBounds[1],
+            [](float x, float) { return FastSin<FAST_MEDIUM>(x); }, sinRef);
+  checkMath("sin", tiers[2], angle, zero, false, sinBounds[2],
+            [](float x, float) { return FastSin<FAST_HIGH>(x); }, sinRef);
+  printf("\n");
+}
+
+/**
+ * GOVERNOR
+ *
+ * what each Synth::SetQuality tier costs with 2x oversampling and a note
+ * on every voice, failing when a tier doesn't save at least 5% on the one
+ * before (build/bench-scalar is the one that counts for the Daisy). Then
+ * the governor on made up loads: the tier costs are fixed here so the
+ * results don't depend on the machine. It fails when it doesn't step down
+ * on the first block over the top, doesn't come back up, or keeps
+ * flipping between two tiers
+ */
+
+// blocks at 96kHz/16, each tier costs a fraction of what tier 0 costs
+static int simulateGovernor(const char *name, float seconds, float from,
+                            float to, float switchTime, const float *costs,
+                            int *firstDown) {
+  Governor governor;
+  const float blockRate = 96000.0f / 16.0f;
+  governor.Init(blockRate, Synth::NUM_QUALITY_STEPS + 1);
+  uint32_t random = 1;
+  int changes = 0, maxTier = 0;
+  *firstDown = -1;
+  size_t blocks = static_cast<size_t>(seconds * blockRate);
+  for (size_t b = 0; b < blocks; b++) {
+    float demand = b < switchTime * blockRate ? from : to;
+    // +-5% jitter
+    random = random * 1664525u + 1013904223u;
+    float jitter = 0.95f + 0.1f * (random >> 8) / float(1 << 24);
+    if (governor.Process(demand * costs[governor.GetTier()] * jitter)) {
+      changes++;
+      *firstDown = *firstDown < 0 ? static_cast<int>(b) : *firstDown;
+    }
+    maxTier = governor.GetTier() > maxTier ? governor.GetTier() : maxTier;
+  }
+  printf("%-14s %8d %8d %8d %8d\n", name, changes, maxTier,
+         governor.GetTier(), governor.GetHold());
+  return changes;
+}
+
+static void benchGovernor() {
+  static Synth synth;
+  synth.Init(samplerate);
+  synth.SetFilterOversampling(2);
+  int tiers = synth.GetNumQualityTiers();
+  printf("quality tiers, %d voices each playing, 2x oversampling, %d tiers "
+         "save something%s\n",
+         SWARM_VOICES, tiers, hotPrefix[0] ? ", no SIMD" : "");
+  printf("%-6s %10s %10s\n", "tier", "ns/sample", "of tier 0");
+  std::vector<float> out1(benchSamples), out2(benchSamples);
+  bool bad = false;
+  double first = 0.0, last = 0.0;
+  for (int tier = 0; tier < tiers; tier++) {
+    // fastest of 3, each from fresh notes
+    double best = 0.0;
+    for (int r = 0; r < 3; r++) {
+      synth.Init(samplerate);
+      synth.SetFilterOversampling(2);
+      synth.SetDecay(5.0f);
+      synth.SetFilterQ(0.9f);
+      synth.CommitParams();
+      synth.SetQuality(tier);
+      for (int v = 0; v < SWARM_VOICES; v++) {
+        synth.NoteOn(36 + 5 * v, 100);
+      }
+      double start = now();
+      for (size_t i = 0; i < benchSamples; i += blocksize) {
+        synth.Process(&out1[i], &out2[i], blocksize);
+      }
+      double ns = (now() - start) * 1e9 / benchSamples;
+      best = r == 0 || ns < best ? ns : best;
+    }
+    first = tier == 0 ? best : first;
+    bool saves = tier == 0 || best < last * 0.95;
+    bad |= !saves;
+    printf("%-6d %10.2f %9.0f%%%s\n", tier, best, 100.0 * best / first,
+           saves ? "" : "  SAVES NOTHING");
+    last = best;
+  }
+  printf("\n");
+
+  // the most tiers there can be
+  const float costs[Synth::NUM_QUALITY_STEPS + 1] = {1.0f, 0.85f, 0.6f};
+  const float steepCosts[Synth::NUM_QUALITY_STEPS + 1] = {1.0f, 0.55f, 0.45f};
+  printf("governor, made up loads at 96kHz/16\n");
+  printf("%-14s %8s %8s %8s %8s\n", "load", "changes", "max tier", "end",
+         "hold");
+  int firstDown;
+  // over the top for 2 seconds then quiet, down at once and back to 0
+  int changes = simulateGovernor("spike", 10.0f, 1.2f, 0.3f, 2.0f, costs,
+                                 &firstDown);
+  bool stepped = firstDown != 0 || changes == 0;
+  // tier 1 fits under the high mark but not the low one, it stays there
+  changes = simulateGovernor("between", 60.0f, 0.9f, 0.9f, 0.0f, costs,
+                             &firstDown);
+  stepped |= changes != 1;
+  // tier 1 is well under, tier 0 over: it tries going back up less and
+  // less often
+  changes = simulateGovernor("flapping", 60.0f, 0.9f, 0.9f, 0.0f,
+                             steepCosts, &firstDown);
+  stepped |= changes > 20;
+  if (bad) {
+    printf("FAILED: a quality tier doesn't save anything\n");
+  }
+  if (stepped) {
+    printf("FAILED: the governor didn't step as it should\n");
+  }
+  failed |= bad || stepped;
+  printf("\n");
+}
+
+struct Section {
+  const char *name;
+  void (*run)();
+};
+
+static const Section sections[] = {
+    {"stereo-filter", benchStereoFilter},
+    {"oversampling", benchOversampling},
+    {"oscillator", benchOscillator},
+    {"saws", benchSaws},
+    {"profiles", benchProfiles},
+    {"hotpath", benchHotPath},
+    {"fastmath", benchFastMath},
+    {"governor", benchGovernor},
+};
+
+int main(int argc, char **argv) {
+  const char *outPath = nullptr;
+  const char *baselinePath = nullptr;
+  double tolerance = 0.1;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (arg + 1 >= argc) {
+      fprintf(stderr, "%s needs a value\n", argv[arg]);
+      return 1;
+    }
+    if (strcmp(argv[arg], "-o") == 0) {
+      outPath = argv[++arg];
+    } else if (strcmp(argv[arg], "-c") == 0) {
+      baselinePath = argv[++arg];
+    } else if (strcmp(argv[arg], "-p") == 0) {
+      tolerance = atof(argv[++arg]) / 100.0;
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[arg]);
+      return 1;
+    }
+  }
+
+  // a typo would otherwise run nothing and pass
+  bool unknown = false;
+  for (int i = arg; i < argc; i++) {
+    bool found = false;
+    for (const Section &section : sections) {
+      found |= strcmp(argv[i], section.name) == 0;
+    }
+    if (!found) {
+      fprintf(stderr, "unknown section %s\n", argv[i]);
+      unknown = true;
+    }
+  }
+  if (unknown) {
+    fprintf(stderr, "sections:");
+    for (const Section &section : sections) {
+      fprintf(stderr, " %s", section.name);
+    }
+    fprintf(stderr, "\n");
+    return 1;
+  }
+
+  for (const Section &section : sections) {
+    bool selected = arg == argc;
+    for (int i = arg; i < argc; i++) {
+      selected |= strcmp(argv[i], section.name) == 0;
+    }
+    if (selected) {
+      section.run();
+    }
+  }
+
+  if (failed) {
+    return 1;
+  }
+  if (outPath && !writeHotResults(outPath)) {
+    return 1;
+  }
+  if (baselinePath) {
+    bool passed = checkHotResults(baselinePath, tolerance);
+    // a slow run can be the machine, it has to be slower every time
+    for (int retry = 0; !passed && !hotResults.empty() && retry < 2; retry++) {
+      printf("\nrunning hotpath again in case that was noise\n\n");
+      benchHotPath();
+      passed = checkHotResults(baselinePath, tolerance);
+    }
+    if (!passed) {
+      return 1;
+    }
+  }
+  return 0;
+}
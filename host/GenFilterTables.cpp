@@ -0,0 +1,42 @@
+// Writes FilterTables.cpp with the frequency part of the filter coefficients
+// (see FilterCoeffs.hpp) for each sample rate given on the command line,
+// runs on the computer at build time
+//
+// usage: gen_filter_tables <rate>... > FilterTables.cpp
+
+#include "../FilterCoeffs.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: gen_filter_tables <rate>...\n");
+    return 1;
+  }
+
+  printf("// generated by host/GenFilterTables.cpp, don't edit\n\n");
+  printf("#include \"FilterCoeffs.hpp\"\n");
+
+  for (int i = 1; i < argc; i++) {
+    int sr = atoi(argv[i]);
+    if (sr <= 0) {
+      fprintf(stderr, "bad sample rate %s\n", argv[i]);
+      return 1;
+    }
+    printf("\nstatic const FilterFreqTable filterTable%d = {\n", sr);
+    for (int f = 0; f < FILTER_FREQ_STEPS; f++) {
+      FilterFreqCoeffs c = CalcFilterFreqCoeffs(f, float(sr));
+      // 9 digits is enough to get the same floats back
+      printf("  {%.9g, %.9g, %.9g},\n", c.b0, c.kf, c.gf);
+    }
+    printf("};\n");
+  }
+
+  printf("\nconst FilterTableEntry filterTables[] = {\n");
+  for (int i = 1; i < argc; i++) {
+    int sr = atoi(argv[i]);
+    printf("  {%d.0f, &filterTable%d},\n", sr, sr);
+  }
+  printf("};\n\nconst int numFilterTables = %d;\n", argc - 1);
+  return 0;
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A note/CC event at an absolute time, what the render feeds to Synth
+struct ScoreEvent {
+  enum Type { NOTE_ON = 0, NOTE_OFF, CC };
+  double time; // seconds
+  Type type;
+  uint8_t data1, data2;
+};
+
+typedef std::vector<ScoreEvent> Score;
+
+/**
+ * Reads a Standard MIDI File (format 0 or 1), all channels are merged
+ *
+ * @return false if the file can't be read, isn't a MIDI file or is cut
+ * short
+ */
+inline bool LoadMidiFile(const char *path, Score &score) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f) {
+    return false;
+  }
+  std::vector<uint8_t> d((std::istreambuf_iterator<char>(f)),
+                         std::istreambuf_iterator<char>());
+
+  size_t pos = 0;
+  auto u32 = [&](size_t p) {
+    return (uint32_t(d[p]) << 24) | (uint32_t(d[p + 1]) << 16) |
+           (uint32_t(d[p + 2]) << 8) | d[p + 3];
+  };
+  auto u16 = [&](size_t p) { return uint16_t((d[p] << 8) | d[p + 1]); };
+
+  if (d.size() < 14 || memcmp(&d[0], "MThd", 4) != 0) {
+    return false;
+  }
+  uint16_t tracks = u16(10);
+  uint16_t division = u16(12);
+  if (division & 0x8000) {
+    // SMPTE timing, nobody uses it
+    return false;
+  }
+  pos = 8 + size_t(u32(4));
+
+  // events in ticks first, tempo changes apply to every track
+  struct TickEvent {
+    uint32_t tick;
+    bool tempo;
+    uint32_t usPerQuarter;
+    ScoreEvent ev;
+  };
+  std::vector<TickEvent> events;
+
+  for (uint16_t t = 0; t < tracks; t++) {
+    if (pos > d.size() || d.size() - pos < 8 ||
+        memcmp(&d[pos], "MTrk", 4) != 0) {
+      return false;
+    }
+    size_t len = u32(pos + 4);
+    pos += 8;
+    if (len > d.size() - pos) {
+      return false;
+    }
+    size_t end = pos + len;
+    uint32_t tick = 0;
+    uint8_t status = 0;
+
+    // false when the track ends in the middle
+    auto readVarLen = [&](uint32_t &v) {
+      v = 0;
+      while (pos < end) {
+        uint8_t b = d[pos++];
+        v = (v << 7) | (b & 0x7f);
+        if (!(b & 0x80)) {
+          return true;
+        }
+      }
+      return false;
+    };
+    auto readByte = [&](uint8_t &b) {
+      if (pos >= end) {
+        return false;
+      }
+      b = d[pos++];
+      return true;
+    };
+
+    while (pos < end) {
+      uint32_t delta;
+      if (!readVarLen(delta)) {
+        return false;
+      }
+      tick += delta;
+      if (pos >= end) {
+        return false;
+      }
+      // running status
+      if (d[pos] & 0x80) {
+        status = d[pos++];
+      } else if (status == 0) {
+        return false;
+      }
+
+      if (status == 0xff) {
+        uint8_t type;
+        uint32_t len;
+        if (!readByte(type) || !readVarLen(len) || len > end - pos) {
+          return false;
+        }
+        if (type == 0x51 && len == 3) {
+          TickEvent te = {};
+          te.tick = tick;
+          te.tempo = true;
+          te.usPerQuarter = (d[pos] << 16) | (d[pos + 1] << 8) | d[pos + 2];
+          events.push_back(te);
+        }
+        pos += len;
+        status = 0;
+      } else if (status == 0xf0 || status == 0xf7) {
+        uint32_t len;
+        if (!readVarLen(len) || len > end - pos) {
+          return false;
+        }
+        pos += len;
+        status = 0;
+      } else {
+        uint8_t type = status & 0xf0;
+        uint8_t d1, d2 = 0;
+        if (!readByte(d1)) {
+          return false;
+        }
+        if (type != 0xc0 && type != 0xd0 && !readByte(d2)) {
+          return false;
+        }
+        TickEvent te = {};
+        te.tick = tick;
+        te.ev.data1 = d1;
+        te.ev.data2 = d2;
+        if (type == 0x90 && d2 > 0) {
+          te.ev.type = ScoreEvent::NOTE_ON;
+        } else if (type == 0x80 || type == 0x90) {
+          te.ev.type = ScoreEvent::NOTE_OFF;
+        } else if (type == 0xb0) {
+          te.ev.type = ScoreEvent::CC;
+        } else {
+          continue;
+        }
+        events.push_back(te);
+      }
+    }
+  }
+
+  std::stable_sort(events.begin(), events.end(),
+                   [](const TickEvent &a, const TickEvent &b) {
+                     return a.tick < b.tick;
+                   });
+
+  // ticks to seconds with the tempo map
+  double usPerTick = 500000.0 / division; // 120 BPM until told otherwise
+  double time = 0.0;
+  uint32_t lastTick = 0;
+  for (const TickEvent &te : events) {
+    time += (te.tick - lastTick) * usPerTick * 1e-6;
+    lastTick = te.tick;
+    if (te.tempo) {
+      usPerTick = double(te.usPerQuarter) / division;
+    } else {
+      ScoreEvent ev = te.ev;
+      ev.time = time;
+      score.push_back(ev);
+    }
+  }
+  return true;
+}
+
+/**
+ * Reads a scripted note list, one event per line:
+ *
+ *   <seconds> on <note> <velocity>
+ *   <seconds> off <note>
+ *   <seconds> cc <number> <value>
+ *
+ * Everything after # is a comment
+ *
+ * @return false if the file can't be read or a line doesn't parse
+ */
+inline bool LoadNoteList(const char *path, Score &score) {
+  std::ifstream f(path);
+  if (!f) {
+    return false;
+  }
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(f, line)) {
+    ++lineNumber;
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      // empty line
+      continue;
+    }
+    std::istringstream ss(line);
+    double time = 0.0;
+    std::string type;
+    ss >> time >> type;
+    int d1 = 0, d2 = 0;
+    ScoreEvent ev;
+    ev.time = time;
+    if (type == "on" && (ss >> d1 >> d2)) {
+      ev.type = ScoreEvent::NOTE_ON;
+    } else if (type == "off" && (ss >> d1)) {
+      ev.type = ScoreEvent::NOTE_OFF;
+    } else if (type == "cc" && (ss >> d1 >> d2)) {
+      ev.type = ScoreEvent::CC;
+    } else {
+      fprintf(stderr, "%s:%d: can't parse \"%s\"\n", path, lineNumber,
+              line.c_str());
+      return false;
+    }
+    // MIDI data bytes are 7 bit
+    if (d1 < 0 || d1 > 127 || d2 < 0 || d2 > 127) {
+      fprintf(stderr, "%s:%d: value out of range 0-127 in \"%s\"\n", path,
+              lineNumber, line.c_str());
+      return false;
+    }
+    ev.data1 = uint8_t(d1);
+    ev.data2 = uint8_t(d2);
+    score.push_back(ev);
+  }
+  std::stable_sort(score.begin(), score.end(),
+                   [](const ScoreEvent &a, const ScoreEvent &b) {
+                     return a.time < b.time;
+                   });
+  return true;
+}
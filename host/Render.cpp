@@ -0,0 +1,172 @@
+// Offline render of the Synth voice graph to a WAV file
+// runs on the computer, no libDaisy needed
+
+#include "../Synth.hpp"
+#include "MidiFile.hpp"
+#include "WavFile.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void usage() {
+  fprintf(stderr,
+          "usage: render [options] <input.mid|input.txt> <output.wav>\n"
+          "  -r <rate>   sample rate (default 96000)\n"
+          "  -b <size>   block size (default 16)\n"
+          "  -t <secs>   tail after the last event (default 2)\n"
+          "  -x <factor> filter oversampling, 1, 2 or 4 (default 1)\n"
+          "  -m <mode>   oscillator, blep or table (default blep)\n"
+          "  -e <size>   samples between envelope values, 1 for every "
+          "sample (default 16)\n"
+          "  -q <tier>   quality tier the governor would step down to, 0 "
+          "is full (default 0)\n");
+}
+
+int main(int argc, char **argv) {
+  float samplerate = 96000.0f;
+  size_t blocksize = 16;
+  double tail = 2.0;
+  int oversampling = 1;
+  Oscillator::Mode oscMode = Oscillator::POLYBLEP;
+  int envInterval = ENVELOPE_CONTROL_INTERVAL;
+  int quality = 0;
+
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (arg + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    if (strcmp(argv[arg], "-r") == 0) {
+      samplerate = atof(argv[++arg]);
+    } else if (strcmp(argv[arg], "-b") == 0) {
+      blocksize = atoi(argv[++arg]);
+    } else if (strcmp(argv[arg], "-t") == 0) {
+      tail = atof(argv[++arg]);
+    } else if (strcmp(argv[arg], "-x") == 0) {
+      oversampling = atoi(argv[++arg]);
+    } else if (strcmp(argv[arg], "-e") == 0) {
+      envInterval = atoi(argv[++arg]);
+    } else if (strcmp(argv[arg], "-q") == 0) {
+      quality = atoi(argv[++arg]);
+    } else if (strcmp(argv[arg], "-m") == 0) {
+      arg++;
+      if (strcmp(argv[arg], "table") == 0) {
+        oscMode = Oscillator::WAVETABLE;
+      } else if (strcmp(argv[arg], "blep") != 0) {
+        usage();
+        return 1;
+      }
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (argc - arg != 2 || samplerate <= 0.0f || blocksize == 0 ||
+      envInterval < 1 || quality < 0) {
+    usage();
+    return 1;
+  }
+  const char *inPath = argv[arg];
+  const char *outPath = argv[arg + 1];
+
+  // anything that isn't a .mid is read as a note list
+  Score score;
+  size_t len = strlen(inPath);
+  bool isMidi = len > 4 && (strcmp(inPath + len - 4, ".mid") == 0 ||
+                            strcmp(inPath + len - 4, ".MID") == 0);
+  bool loaded = isMidi ? LoadMidiFile(inPath, score)
+                       : LoadNoteList(inPath, score);
+  if (!loaded) {
+    fprintf(stderr, "can't read %s\n", inPath);
+    return 1;
+  }
+
+  WavWriter wav;
+  if (!wav.Open(outPath, uint32_t(samplerate))) {
+    fprintf(stderr, "can't write %s\n", outPath);
+    return 1;
+  }
+
+  static Synth synth;
+  synth.Init(samplerate);
+  synth.SetFilterOversampling(oversampling);
+  synth.SetOscMode(oscMode);
+  synth.SetEnvelopeMode(envInterval == 1 ? Envelope::AUDIO_RATE
+                                         : Envelope::CONTROL_RATE,
+                        envInterval);
+  // only the tiers that save something with this setup
+  if (quality >= synth.GetNumQualityTiers()) {
+    fprintf(stderr, "tier %d does nothing here, the last one is %d\n",
+            quality, synth.GetNumQualityTiers() - 1);
+    return 1;
+  }
+  synth.SetQuality(quality);
+
+  double length = (score.empty() ? 0.0 : score.back().time) + tail;
+  size_t totalSamples = size_t(length * samplerate);
+  float *out1 = new float[blocksize];
+  float *out2 = new float[blocksize];
+  size_t next = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t sample = 0; sample < totalSamples; sample += blocksize) {
+    {
+      // events land on their own sample inside the block
+      PROFILE_SCOPE(PROFILE_MIDI);
+      while (next < score.size() &&
+             size_t(score[next].time * samplerate + 0.5) < sample + blocksize) {
+        const ScoreEvent &ev = score[next++];
+        size_t at = size_t(ev.time * samplerate + 0.5);
+        Synth::Event event;
+        event.offset = at > sample ? at - sample : 0;
+        event.data1 = ev.data1;
+        event.data2 = ev.data2;
+        switch (ev.type) {
+        case ScoreEvent::NOTE_ON:
+          event.type = Synth::NOTE_ON;
+          break;
+        case ScoreEvent::NOTE_OFF:
+          event.type = Synth::NOTE_OFF;
+          break;
+        case ScoreEvent::CC:
+          event.type = Synth::CC;
+          break;
+        }
+        synth.QueueEvent(event);
+      }
+    }
+    synth.Process(out1, out2, blocksize);
+    PROFILE_END_BLOCK();
+    wav.Write(out1, out2, blocksize);
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  double elapsed = std::chrono::duration<double>(end - start).count();
+  double rendered = double(totalSamples) / samplerate;
+  wav.Close();
+  delete[] out1;
+  delete[] out2;
+
+  printf("%zu events, %.2f s of audio in %.3f s (%.1fx real time)\n",
+         score.size(), rendered, elapsed,
+         elapsed > 0.0 ? rendered / elapsed : 0.0);
+
+#ifdef SWARM_PROFILE
+  // ticks per block for each stage, then the histogram
+  printf("stage       min       avg       max  histogram from 2^%d\n",
+         PROFILE_HISTOGRAM_SHIFT);
+  for (int s = 0; s < PROFILE_NUM_STAGES; s++) {
+    const Profiler::Stats &stats = Profiler::Get().GetStats(s);
+    printf("%-5s %9u %9.0f %9u ", Profiler::GetStageName(s),
+           stats.blocks > 0 ? stats.min : 0, stats.GetAvg(), stats.max);
+    for (int b = 0; b < PROFILE_HISTOGRAM_BINS; b++) {
+      printf(" %u", stats.histogram[b]);
+    }
+    printf("\n");
+  }
+#endif
+  return 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+// Writes interleaved stereo 32 bit float WAV files
+class WavWriter {
+public:
+  WavWriter() {}
+  ~WavWriter() { Close(); }
+
+  bool Open(const char *path, uint32_t sr) {
+    file_ = fopen(path, "wb");
+    if (!file_) {
+      return false;
+    }
+    sr_ = sr;
+    frames_ = 0;
+    // header gets the real sizes on Close
+    writeHeader();
+    return true;
+  }
+
+  void Write(const float *left, const float *right, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      float frame[2] = {left[i], right[i]};
+      fwrite(frame, sizeof(float), 2, file_);
+    }
+    frames_ += size;
+  }
+
+  void Close() {
+    if (!file_) {
+      return;
+    }
+    fseek(file_, 0, SEEK_SET);
+    writeHeader();
+    fclose(file_);
+    file_ = nullptr;
+  }
+
+private:
+  FILE *file_ = nullptr;
+  uint32_t sr_, frames_;
+
+  void write32(uint32_t v) { fwrite(&v, 4, 1, file_); }
+  void write16(uint16_t v) { fwrite(&v, 2, 1, file_); }
+
+  void writeHeader() {
+    const uint16_t channels = 2;
+    const uint16_t bits = 32;
+    uint32_t dataSize = frames_ * channels * (bits / 8);
+    fwrite("RIFF", 1, 4, file_);
+    write32(36 + dataSize);
+    fwrite("WAVEfmt ", 1, 8, file_);
+    write32(16);
+    write16(3); // IEEE float
+    write16(channels);
+    write32(sr_);
+    write32(sr_ * channels * (bits / 8));
+    write16(channels * (bits / 8));
+    write16(bits);
+    fwrite("data", 1, 4, file_);
+    write32(dataSize);
+  }
+};